@@ -75,6 +75,10 @@ endif
 #LDFLAGS_SHARED?=-fPIC -shared
 LDFLAGS_SHARED?=-shared
 
+ifneq (${OS},w32)
+LDFLAGS+=-pthread
+endif
+
 ifeq (${OS},w32)
 EXT_EXE=.exe
 EXT_SO=.dll
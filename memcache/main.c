@@ -56,7 +56,7 @@ static void main_version(void) {
 }
 
 static void main_help(const char *arg UNUSED) {
-	printf ("mcsdbd [-hv] [-p port] [sdbfile]\n");
+	printf ("mcsdbd [-hv] [-m megabytes] [-p port] [sdbfile]\n");
 }
 
 static int mcsdb_client_accept(int fd) {
@@ -264,7 +264,8 @@ static int net_loop(int port) {
 	for (;;) {
 		for (i=0;i<ms->nfds; i++)
 			ms->fds[i].revents = 0;
-		r = poll (ms->fds, ms->nfds, -1);
+		r = poll (ms->fds, ms->nfds, 1000);
+		sdb_expire_tick (ms->sdb, MCSDB_EXPIRE_BATCH);
 		if (r<1)
 			continue;
 		if (ms->fds[0].revents) {
@@ -321,12 +322,14 @@ static int net_loop(int port) {
 int main(int argc, char **argv) {
 	const char *file = MCSDB_FILE;
 	int port = MCSDB_PORT;
+	ut64 maxbytes = 0;
 	char c, ret = 0;
 
-	while ((c = getopt (argc, argv, "hvp:")) != -1) {
+	while ((c = getopt (argc, argv, "hvm:p:")) != -1) {
 		switch (c) {
 		case 'h': main_help (argv[0]); return 0;
 		case 'v': main_version (); return 0;
+		case 'm': maxbytes = sdb_atoi (optarg) << 20; break;
 		case 'p': port = atoi (optarg); break;
 		}
 	}
@@ -338,6 +341,9 @@ int main(int argc, char **argv) {
 		file = argv[optind];
 	setup_signals ();
 	ms = mcsdb_new (file);
+	if (ms && maxbytes) {
+		sdb_memory_limit (ms->sdb, maxbytes);
+	}
 	ret = net_loop (port);
 	mcsdb_free (ms);
 	return ret;
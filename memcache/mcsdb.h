@@ -12,6 +12,7 @@
 #define MCSDB_VERSION "0.2"
 #define MCSDB_MAX_CLIENTS 16
 #define MCSDB_MAX_BUFFER 4096
+#define MCSDB_EXPIRE_BATCH 64
 
 #include "cmds.h"
 
@@ -59,9 +60,10 @@ McSdb *mcsdb_new(const char *file);
 void mcsdb_free(McSdb *ms);
 void mcsdb_flush(McSdb *ms);
 int mcsdb_set(McSdb *ms, const char *key, const char *value, ut64 exptime, ut32 cas);
+int mcsdb_set_bin(McSdb *ms, const char *key, const ut8 *value, ut32 len, ut64 exptime, ut32 cas);
 int mcsdb_cas(McSdb *ms, const char *key, const char *value, ut64 exptime, ut32 cas);
 int mcsdb_touch(McSdb *ms, const char *key, ut64 exptime);
-char *mcsdb_get(McSdb *ms, const char *key, ut64 *exptime, ut32 *cas);
+char *mcsdb_get(McSdb *ms, const char *key, ut32 *len, ut64 *exptime, ut32 *cas);
 char *mcsdb_incr(McSdb *ms, const char *key, ut64 val);
 char *mcsdb_decr(McSdb *ms, const char *key, ut64 val);
 int mcsdb_replace(McSdb *ms, const char *key, ut64 exptime, const char *body);
@@ -75,6 +77,7 @@ int net_listen(int port);
 int net_close(int s);
 int net_flush(int fd);
 int net_printf(int fd, const char *fmt, ...);
+int net_write(int fd, const char *buf, int len);
 char *net_readnl(int fd);
 
 /* client */
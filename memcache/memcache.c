@@ -51,7 +51,11 @@ char *mcsdb_decr(McSdb *ms, const char *key, ut64 val) {
 }
 
 int mcsdb_set(McSdb *ms, const char *key, const char *value, ut64 exptime, ut32 cas) {
-	int ret = sdb_set (ms->sdb, key, value, cas);
+	return mcsdb_set_bin (ms, key, (const ut8 *)value, strlen (value), exptime, cas);
+}
+
+int mcsdb_set_bin(McSdb *ms, const char *key, const ut8 *value, ut32 len, ut64 exptime, ut32 cas) {
+	int ret = sdb_set_bin (ms->sdb, key, value, len, cas);
 	sdb_expire_set (ms->sdb, key, exptime, cas);
 	ms->sets++;
 	return ret;
@@ -126,9 +130,9 @@ int mcsdb_cas(McSdb *ms, const char *key, const char *value, ut64 exptime, ut32
 }
 
 /* retrieval */
-char *mcsdb_get(McSdb *ms, const char *key, ut64 *exptime, ut32 *cas) {
+char *mcsdb_get(McSdb *ms, const char *key, ut32 *len, ut64 *exptime, ut32 *cas) {
 	ut32 n;
-	char *s = sdb_get (ms->sdb, key, &n);
+	char *s = (char *)sdb_get_bin (ms->sdb, key, len, &n);
 	if (s) ms->hits++;
 	else ms->misses++;
 	ms->gets++;
@@ -56,6 +56,19 @@ int net_printf (int fd, const char *fmt, ...) {
 	return n;
 }
 
+/* raw bytes, the value may contain zeroes */
+int net_write (int fd, const char *buf, int len) {
+	if (netbuflen + len > sizeof (netbuf)) {
+		net_flush (fd);
+	}
+	if (len > sizeof (netbuf)) {
+		return write (fd, buf, len);
+	}
+	memcpy (netbuf + netbuflen, buf, len);
+	netbuflen += len;
+	return len;
+}
+
 void net_sockopt (int fd) {
 #if __linux__
 	struct linger ling = {0, 0};
@@ -12,7 +12,7 @@ static inline void strtolower (char *s) {
 
 static void handle_get(McSdb *ms, int fd, char *key, int smode) {
 	ut64 exptime = 0LL;
-	ut32 cas;
+	ut32 cas, len;
 	int n = 0;
 	char *s, *k, *K = key;
 	if (!key) {
@@ -22,14 +22,15 @@ static void handle_get(McSdb *ms, int fd, char *key, int smode) {
 	do {
 		k = strchr (K, ' ');
 		if (k) *k = 0;
-		s = mcsdb_get (ms, K, &exptime, &cas);
+		s = mcsdb_get (ms, K, &len, &exptime, &cas);
 		if (s) {
 			if (smode) net_printf (fd, 
 				"VALUE %s %llu %d %d\r\n",
-				K, exptime, (int)strlen (s), cas);
+				K, exptime, (int)len, cas);
 			else net_printf (fd,
-				"VALUE %s %llu %d\r\n", K, exptime, (int)strlen (s));
-			net_printf (fd, "%s\r\n", s);
+				"VALUE %s %llu %d\r\n", K, exptime, (int)len);
+			net_write (fd, s, len);
+			net_printf (fd, "\r\n");
 			free (s);
 			n++;
 //break;
@@ -57,7 +58,7 @@ int protocol_handle (McSdb *ms, McSdbClient *c, char *buf) {
 		b = buf;
 		b[c->len-1] = 0;
 		switch (c->cmdhash) {
-		case MCSDB_CMD_SET: mcsdb_set (ms, c->key, b, c->exptime, 0); break;
+		case MCSDB_CMD_SET: mcsdb_set_bin (ms, c->key, (const ut8 *)b, c->len - 1, c->exptime, 0); break;
 		case MCSDB_CMD_APPEND: mcsdb_append (ms, c->key, c->exptime, b); break;
 		case MCSDB_CMD_ADD: stored = mcsdb_add (ms, c->key, c->exptime, b); break;
 		case MCSDB_CMD_PREPEND: mcsdb_prepend (ms, c->key, c->exptime, b); break;
@@ -147,10 +148,11 @@ int protocol_handle (McSdb *ms, McSdbClient *c, char *buf) {
 		net_printf (fd, "STAT cmd_set %llu\r\n", ms->sets);
 		net_printf (fd, "STAT get_hits %llu\r\n", ms->hits);
 		net_printf (fd, "STAT get_misses %llu\r\n", ms->misses);
-		net_printf (fd, "STAT evictions %llu\r\n", ms->evictions);
+		net_printf (fd, "STAT evictions %llu\r\n", ms->evictions + ms->sdb->evictions);
 		net_printf (fd, "STAT bytes_read %llu\r\n", ms->bread);
 		net_printf (fd, "STAT bytes_written %llu\r\n", ms->bwrite);
-		// ?? net_printf (fd, "STAT limit_maxbytes 0\r\n");
+		net_printf (fd, "STAT bytes %llu\r\n", ms->sdb->mem);
+		net_printf (fd, "STAT limit_maxbytes %llu\r\n", ms->sdb->mem_limit);
 		net_printf (fd, "STAT threads 1\r\n");
 		net_printf (fd, "END\r\n");
 		break;
@@ -1,6 +1,9 @@
 /* Public Domain */
 
 #include "buffer.h"
+#if !__SDB_WINDOWS__
+#include <sys/uio.h>
+#endif
 
 void buffer_init(buffer *s, BufferOp op, int fd, char *buf, ut32 len) {
 	s->x = buf;
@@ -8,6 +11,14 @@ void buffer_init(buffer *s, BufferOp op, int fd, char *buf, ut32 len) {
 	s->op = op;
 	s->p = 0;
 	s->n = len;
+	s->swap = NULL;
+	s->user = NULL;
+}
+
+/* full buffers go to fn, which hands back another one of the same size */
+void buffer_swap(buffer *s, BufferSwap fn, void *user) {
+	s->swap = fn;
+	s->user = user;
 }
 
 static int allwrite(BufferOp op, int fd, const char *buf, ut32 len) {
@@ -29,6 +40,10 @@ int buffer_flush(buffer *s) {
 		return 1;
 	}
 	s->p = 0;
+	if (s->swap) {
+		s->x = s->swap (s->user, s->x, p);
+		return s->x != NULL;
+	}
 	return allwrite (s->op, s->fd, s->x, p);
 }
 
@@ -56,3 +71,43 @@ int buffer_putflush(buffer *s, const char *buf, ut32 len) {
 	}
 	return allwrite (s->op, s->fd, buf, len);
 }
+
+/* what is buffered and buf go out in one writev, buf is not copied.
+ * swapped buffers only take copies */
+int buffer_putdirect(buffer *s, const char *buf, ut32 len) {
+	if (s->swap) {
+		return buffer_putalign (s, buf, len);
+	}
+#if __SDB_WINDOWS__
+	return buffer_putflush (s, buf, len);
+#else
+	struct iovec iov[2];
+	int i = s->p? 0: 1;
+	if (s->op != (BufferOp)write) {
+		return buffer_putflush (s, buf, len);
+	}
+	if (!len) {
+		return 1;
+	}
+	iov[0].iov_base = s->x;
+	iov[0].iov_len = s->p;
+	iov[1].iov_base = (void *)buf;
+	iov[1].iov_len = len;
+	s->p = 0;
+	while (i < 2) {
+		ssize_t n = writev (s->fd, iov + i, 2 - i);
+		if (n < 1) {
+			return 0;
+		}
+		while (i < 2 && (size_t)n >= iov[i].iov_len) {
+			n -= iov[i].iov_len;
+			i++;
+		}
+		if (i < 2) {
+			iov[i].iov_base = (char *)iov[i].iov_base + n;
+			iov[i].iov_len -= n;
+		}
+	}
+	return 1;
+#endif
+}
@@ -4,6 +4,8 @@
 #include "types.h"
 
 typedef int (*BufferOp)(int, const char *, int);
+/* takes a full buffer instead of writing it, returns the one to fill next */
+typedef char *(*BufferSwap)(void *, char *, unsigned int);
 
 typedef struct buffer {
 	char *x;
@@ -11,18 +13,22 @@ typedef struct buffer {
 	unsigned int n;
 	int fd;
 	BufferOp op;
+	BufferSwap swap;
+	void *user;
 } buffer;
 
-#define BUFFER_INIT(op,fd,buf,len) { (buf), 0, (len), (fd), (op) }
+#define BUFFER_INIT(op,fd,buf,len) { (buf), 0, (len), (fd), (op), NULL, NULL }
 #define BUFFER_INSIZE 8192
 #define BUFFER_OUTSIZE 8192
 
 extern void buffer_init(buffer *,BufferOp,int,char *,unsigned int);
+extern void buffer_swap(buffer *,BufferSwap,void *);
 
 extern int buffer_flush(buffer *);
 extern int buffer_put(buffer *,const char *,unsigned int);
 extern int buffer_putalign(buffer *,const char *,unsigned int);
 extern int buffer_putflush(buffer *,const char *,unsigned int);
+extern int buffer_putdirect(buffer *,const char *,unsigned int);
 
 #define buffer_PUTC(s,c) \
   ( ((s)->n != (s)->p) \
@@ -0,0 +1,354 @@
+/* sdb - MIT - Copyright 2018 - pancake */
+
+#include <fcntl.h>
+#include "sdb.h"
+#include "cdb.h"
+#include "cdb_make.h"
+
+/* streams records straight into a new cdb file, nothing is kept in the
+ * memory table. the (hash,pos) pairs needed for the hash tables can be
+ * capped with sdb_builder_memory, the rest is spilled next to the file */
+
+static char *suffix(const char *file, const char *ext) {
+	int flen = strlen (file);
+	int elen = strlen (ext);
+	char *str = malloc (flen + elen + 1);
+	if (str) {
+		memcpy (str, file, flen);
+		memcpy (str + flen, ext, elen + 1);
+	}
+	return str;
+}
+
+static int builder_open(const char *path) {
+	return open (path, O_BINARY | O_RDWR | O_CREAT | O_TRUNC, SDB_MODE);
+}
+
+SDB_API SdbBuilder *sdb_builder_new(const char *file, int dups) {
+	SdbBuilder *b;
+	if (!file || !*file) {
+		return NULL;
+	}
+	b = R_NEW0 (SdbBuilder);
+	if (!b) {
+		return NULL;
+	}
+	b->spill = -1;
+	b->dups = dups;
+	b->file = strdup (file);
+	b->tmp = suffix (file, ".tmp");
+	if (!b->file || !b->tmp) {
+		goto fail;
+	}
+	b->fd = builder_open (b->tmp);
+	if (b->fd == -1) {
+		eprintf ("sdb: Cannot open '%s' for writing.\n", b->tmp);
+		goto fail;
+	}
+	if (!cdb_make_start (&b->m, b->fd)) {
+		close (b->fd);
+		unlink (b->tmp);
+		goto fail;
+	}
+	return b;
+fail:
+	free (b->file);
+	free (b->tmp);
+	free (b);
+	return NULL;
+}
+
+static void builder_close_spill(SdbBuilder *b) {
+	if (b->spill != -1) {
+		close (b->spill);
+		b->spill = -1;
+		unlink (b->spath);
+	}
+	R_FREE (b->spath);
+}
+
+SDB_API void sdb_builder_free(SdbBuilder *b) {
+	if (!b) {
+		return;
+	}
+	cdb_make_free (&b->m);
+	builder_close_spill (b);
+	if (b->fd != -1) {
+		close (b->fd);
+		unlink (b->tmp);
+	}
+	free (b->file);
+	free (b->tmp);
+	free (b);
+}
+
+/* bytes kept for the (hash,pos) pairs before they go to <file>.spill */
+SDB_API bool sdb_builder_memory(SdbBuilder *b, ut64 bytes) {
+	ut64 limit = bytes / sizeof (struct cdb_hp);
+	if (!b || !limit) {
+		return false;
+	}
+	if (b->spill == -1) {
+		b->spath = suffix (b->file, ".spill");
+		if (!b->spath) {
+			return false;
+		}
+		b->spill = builder_open (b->spath);
+		if (b->spill == -1) {
+			R_FREE (b->spath);
+			return false;
+		}
+	}
+	return cdb_make_spill (&b->m, b->spill, limit > UT32_MAX? UT32_MAX: (ut32)limit);
+}
+
+/* records are staged in buf, or in size bytes from the heap if buf is
+ * NULL, instead of 8K. buf must outlive b */
+SDB_API bool sdb_builder_buffer(SdbBuilder *b, char *buf, ut32 size) {
+	return b && cdb_make_buffer (&b->m, buf, size);
+}
+
+/* keys must then be added in strictly ascending order, they are front
+ * coded with a restart point every interval keys (0 for CDB_RESTART) and
+ * looked up by binary search instead of hash tables. there are no dups */
+SDB_API bool sdb_builder_sorted(SdbBuilder *b, ut32 interval) {
+	return b && cdb_make_sorted (&b->m, interval? interval: CDB_RESTART);
+}
+
+/* cb is called every `every` records, and once more when finishing */
+SDB_API void sdb_builder_progress(SdbBuilder *b, SdbBuilderProgress cb, void *user, ut64 every) {
+	b->progress = cb;
+	b->user = user;
+	b->every = every;
+}
+
+SDB_API bool sdb_builder_add_bin(SdbBuilder *b, const char *key, const ut8 *val, ut32 len) {
+	ut32 klen;
+	if (!b || !key || !val || !len) {
+		return false;
+	}
+	klen = strlen (key);
+	if (klen >= SDB_KSZ || len >= SDB_VSZ) {
+		return false;
+	}
+	if (!cdb_make_add (&b->m, key, klen, (const char *)val, len)) {
+		return false;
+	}
+	b->records++;
+	if (b->progress && b->every && !(b->records % b->every)) {
+		b->progress (b->user, b->records, b->m.pos);
+	}
+	return true;
+}
+
+SDB_API bool sdb_builder_add(SdbBuilder *b, const char *key, const char *val) {
+	return val && sdb_builder_add_bin (b, key, (const ut8 *)val, strlen (val));
+}
+
+static int hp_cmp(const void *a, const void *b) {
+	const struct cdb_hp *x = a, *y = b;
+	if (x->h != y->h) {
+		return x->h < y->h? -1: 1;
+	}
+	return x->p < y->p? -1: x->p > y->p;
+}
+
+static int pos_cmp(const void *a, const void *b) {
+	ut32 x = *(const ut32 *)a, y = *(const ut32 *)b;
+	return x < y? -1: x > y;
+}
+
+static bool same_key(const struct cdb *db, ut32 a, ut32 b) {
+	ut8 ka = db->map[a], kb = db->map[b];
+	return ka == kb && !memcmp (db->map + a + KVLSZ, db->map + b + KVLSZ, ka);
+}
+
+/* positions of the records shadowed by another one with the same key.
+ * equal keys have equal hashes, so they sit in the same table */
+static ut32 *builder_dups(const struct cdb *db, bool last, ut32 *ndead) {
+	ut32 i, j, k, n, ncap = 0, *dead = NULL;
+	struct cdb_hp *hp = NULL;
+	ut32 hcap = 0;
+	*ndead = 0;
+	for (i = 0; i < 256; i++) {
+		ut32 hpos, next, slots, count = 0;
+		ut32_unpack (db->map + i * 4, &hpos);
+		if (i < 255) {
+			ut32_unpack (db->map + (i + 1) * 4, &next);
+		} else {
+			next = db->size;
+		}
+		if (next < hpos || next > db->size) {
+			break;
+		}
+		slots = (next - hpos) / 8;
+		if (slots > hcap) {
+			struct cdb_hp *h = realloc (hp, slots * sizeof (struct cdb_hp));
+			if (!h) {
+				goto fail;
+			}
+			hp = h;
+			hcap = slots;
+		}
+		for (j = 0; j < slots; j++) {
+			ut32_unpack (db->map + hpos + j * 8, &hp[count].h);
+			ut32_unpack (db->map + hpos + j * 8 + 4, &hp[count].p);
+			if (hp[count].p) {
+				count++;
+			}
+		}
+		if (count > 1) {
+			qsort (hp, count, sizeof (struct cdb_hp), hp_cmp);
+		}
+		for (j = 0; j < count; j = n) {
+			for (n = j + 1; n < count && hp[n].h == hp[j].h; n++) {
+			}
+			/* within a run the positions are ascending, p = 0 marks the dead */
+			for (k = j; k < n; k++) {
+				ut32 m, *victim;
+				for (m = k + 1; m < n && hp[k].p; m++) {
+					if (!hp[m].p || !same_key (db, hp[k].p, hp[m].p)) {
+						continue;
+					}
+					victim = last? &hp[k].p: &hp[m].p;
+					if (*ndead == ncap) {
+						ut32 *d;
+						ncap = ncap? ncap * 2: 64;
+						d = realloc (dead, ncap * sizeof (ut32));
+						if (!d) {
+							goto fail;
+						}
+						dead = d;
+					}
+					dead[(*ndead)++] = *victim;
+					*victim = 0;
+				}
+			}
+		}
+	}
+	free (hp);
+	if (dead) {
+		qsort (dead, *ndead, sizeof (ut32), pos_cmp);
+	}
+	return dead;
+fail:
+	free (hp);
+	free (dead);
+	*ndead = 0;
+	return NULL;
+}
+
+/* copies the records of tmp but the dead ones into a new file */
+static bool builder_rewrite(SdbBuilder *b, const struct cdb *db, const ut32 *dead, ut32 ndead) {
+	struct cdb_make m;
+	ut32 pos, end, di = 0;
+	char *path = suffix (b->file, ".tmp2");
+	int fd;
+	if (!path) {
+		return false;
+	}
+	fd = builder_open (path);
+	if (fd == -1 || !cdb_make_start (&m, fd)) {
+		goto fail;
+	}
+	if (b->spill != -1) {
+		if (ftruncate (b->spill, 0) || !seek_set (b->spill, 0)) {
+			goto fail;
+		}
+		cdb_make_spill (&m, b->spill, b->m.hplimit);
+	}
+	ut32_unpack (db->map, &end);
+	for (pos = sizeof (m.final); pos + KVLSZ <= end; ) {
+		ut32 klen = (ut8)db->map[pos];
+		ut32 vlen = (ut8)db->map[pos + 1] | ((ut8)db->map[pos + 2] << 8) | ((ut8)db->map[pos + 3] << 16);
+		if (klen < 1 || vlen < 1 || pos + KVLSZ + klen + vlen > end) {
+			break;
+		}
+		if (di < ndead && dead[di] == pos) {
+			di++;
+		} else {
+			const char *key = db->map + pos + KVLSZ;
+			if (!cdb_make_add (&m, key, klen - 1, key + klen, vlen - 1)) {
+				cdb_make_free (&m);
+				goto fail;
+			}
+		}
+		pos += KVLSZ + klen + vlen;
+	}
+	if (!cdb_make_finish (&m)) {
+		goto fail;
+	}
+	close (fd);
+	close (b->fd);
+	b->fd = -1;
+	unlink (b->tmp);
+	free (b->tmp);
+	b->tmp = path;
+	b->records -= ndead;
+	b->m.pos = m.pos;
+	return true;
+fail:
+	if (fd != -1) {
+		close (fd);
+		unlink (path);
+	}
+	free (path);
+	return false;
+}
+
+static bool builder_dedup(SdbBuilder *b) {
+	struct cdb db = {0};
+	ut32 *dead, ndead = 0;
+	bool ret = true;
+	int fd = open (b->tmp, O_BINARY | O_RDONLY);
+	if (fd == -1) {
+		return false;
+	}
+	db.fd = -1;
+	if (!cdb_init (&db, fd) || !db.map) {
+		cdb_free (&db);
+		close (fd);
+		return false;
+	}
+	dead = builder_dups (&db, b->dups == SDB_BUILDER_DUP_LAST, &ndead);
+	if (ndead) {
+		ret = builder_rewrite (b, &db, dead, ndead);
+	}
+	free (dead);
+	cdb_free (&db);
+	close (fd);
+	return ret;
+}
+
+/* writes the hash tables and moves the file into place, b is freed */
+SDB_API bool sdb_builder_finish(SdbBuilder *b) {
+	bool ret, sorted;
+	if (!b) {
+		return false;
+	}
+	sorted = b->m.k != NULL;
+	ret = cdb_make_finish (&b->m);
+	if (ret && b->dups != SDB_BUILDER_DUP_KEEP && !sorted) {
+		ret = builder_dedup (b);
+	}
+	if (ret && b->fd != -1) {
+		close (b->fd);
+		b->fd = -1;
+	}
+#if __SDB_WINDOWS__
+	if (ret) {
+		unlink (b->file);
+	}
+#endif
+	if (ret && rename (b->tmp, b->file)) {
+		ret = false;
+	}
+	if (ret && b->progress) {
+		b->progress (b->user, b->records, b->m.pos);
+	}
+	if (!ret) {
+		unlink (b->tmp);
+	}
+	sdb_builder_free (b);
+	return ret;
+}
@@ -1,8 +1,13 @@
 /* Public domain - author D. J. Bernstein, modified by pancake - 2014-2016 */
 
+#if __linux__
+/* MAP_POPULATE and MADV_HUGEPAGE are not part of POSIX */
+#define _DEFAULT_SOURCE 1
+#endif
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include "sdb.h"
 #include "cdb.h"
 #if USE_MMAN
 #include <sys/mman.h>
@@ -24,7 +29,157 @@ bool cdb_getkvlen(struct cdb *c, ut32 *klen, ut32 *vlen, ut32 pos) {
 	return true;
 }
 
+/* full reads only, pread does not move the file offset so readers do not race */
+static bool cdb_pread(int fd, char *buf, ut32 len, ut32 pos) {
+	if (fd == -1) {
+		return false;
+	}
+#if __SDB_WINDOWS__
+	if (!seek_set (fd, pos)) {
+		return false;
+	}
+	while (len > 0) {
+		int r = (int)read (fd, buf, len);
+		if (r < 1) {
+			return false;
+		}
+		buf += r;
+		len -= r;
+	}
+#else
+	while (len > 0) {
+		ssize_t r = pread (fd, buf, len, (off_t)pos);
+		if (r < 1) {
+			return false;
+		}
+		buf += r;
+		pos += r;
+		len -= r;
+	}
+#endif
+	return true;
+}
+
+static void pcache_reset(struct cdb_pcache *pc) {
+	memset (pc->page, 0xff, pc->npages * sizeof (ut32));
+	memset (pc->head, 0xff, pc->npages * sizeof (ut32));
+	memset (pc->ref, 0, pc->npages);
+	pc->hand = 0;
+}
+
+static void pcache_free(struct cdb_pcache *pc) {
+	if (pc) {
+		free (pc->page);
+		free (pc->len);
+		free (pc->next);
+		free (pc->head);
+		free (pc->ref);
+		free (pc->data);
+		free (pc);
+	}
+}
+
+static struct cdb_pcache *pcache_new(ut32 npages) {
+	struct cdb_pcache *pc = calloc (1, sizeof (struct cdb_pcache));
+	if (!pc) {
+		return NULL;
+	}
+	pc->npages = npages;
+	pc->page = malloc (npages * sizeof (ut32));
+	pc->len = calloc (npages, sizeof (ut32));
+	pc->next = malloc (npages * sizeof (ut32));
+	pc->head = malloc (npages * sizeof (ut32));
+	pc->ref = malloc (npages);
+	pc->data = malloc ((size_t)npages * CDB_PAGE_SIZE);
+	if (!pc->page || !pc->len || !pc->next || !pc->head || !pc->ref || !pc->data) {
+		pcache_free (pc);
+		return NULL;
+	}
+	pcache_reset (pc);
+	return pc;
+}
+
+static const char *pcache_get(struct cdb *c, ut32 pageno, ut32 *len) {
+	struct cdb_pcache *pc = c->pc;
+	ut32 slot, want, *link, h = pageno % pc->npages;
+	ut64 off = (ut64)pageno * CDB_PAGE_SIZE;
+	char *data;
+	for (slot = pc->head[h]; slot != UT32_MAX; slot = pc->next[slot]) {
+		if (pc->page[slot] == pageno) {
+			pc->ref[slot] = 1;
+			pc->hits++;
+			*len = pc->len[slot];
+			return pc->data + (size_t)slot * CDB_PAGE_SIZE;
+		}
+	}
+	if (off >= c->size) {
+		return NULL;
+	}
+	/* referenced pages get a second chance */
+	while (pc->ref[pc->hand]) {
+		pc->ref[pc->hand] = 0;
+		pc->hand = (pc->hand + 1) % pc->npages;
+	}
+	slot = pc->hand;
+	pc->hand = (slot + 1) % pc->npages;
+	if (pc->page[slot] != UT32_MAX) {
+		link = &pc->head[pc->page[slot] % pc->npages];
+		while (*link != slot) {
+			link = &pc->next[*link];
+		}
+		*link = pc->next[slot];
+		pc->page[slot] = UT32_MAX;
+	}
+	want = R_MIN (CDB_PAGE_SIZE, c->size - off);
+	data = pc->data + (size_t)slot * CDB_PAGE_SIZE;
+	if (!cdb_pread (c->fd, data, want, (ut32)off)) {
+		return NULL;
+	}
+	pc->misses++;
+	pc->page[slot] = pageno;
+	pc->len[slot] = want;
+	pc->ref[slot] = 1;
+	pc->next[slot] = pc->head[h];
+	pc->head[h] = slot;
+	*len = want;
+	return data;
+}
+
+static void cdb_sections_free(struct cdb *c) {
+	int i;
+	for (i = 0; i < CDB_MAXSECT; i++) {
+		free (c->sdata[i]);
+		c->sdata[i] = NULL;
+	}
+}
+
+void cdb_zfree(struct cdb_zbuf *zb) {
+	free (zb->data);
+	zb->data = NULL;
+	zb->size = zb->len = 0;
+	zb->block = UT32_MAX;
+}
+
+static void cdb_zcache_free(struct cdb *c) {
+	int i;
+	if (c->zc) {
+		for (i = 0; i < CDB_ZCACHE; i++) {
+			cdb_zfree (&c->zc[i]);
+		}
+		free (c->zc);
+		c->zc = NULL;
+	}
+}
+
 void cdb_free(struct cdb *c) {
+	cdb_sections_free (c);
+	cdb_zcache_free (c);
+	c->zdir = NULL;
+	c->nzblocks = 0;
+	c->keys = c->restart = NULL;
+	c->nkeys = c->nrestart = 0;
+	pcache_free (c->pc);
+	c->pc = NULL;
 	if (!c->map) {
 		return;
 	}
@@ -36,8 +191,12 @@ void cdb_free(struct cdb *c) {
 	c->map = NULL;
 }
 
+void cdb_find_init(struct cdb_find_ctx *f) {
+	f->loop = 0;
+}
+
 void cdb_findstart(struct cdb *c) {
-	c->loop = 0;
+	cdb_find_init (&c->find);
 #if !USE_MMAN
 	if (c->fd != -1) {
 		lseek (c->fd, 0, SEEK_SET);
@@ -45,6 +204,378 @@ void cdb_findstart(struct cdb *c) {
 #endif
 }
 
+static void cdb_ext_load(struct cdb *c) {
+	char foot[CDB_EXT_FOOTER], ent[12];
+	ut32 i, dir, tables;
+	cdb_sections_free (c);
+	cdb_zcache_free (c);
+	c->zdir = NULL;
+	c->nzblocks = c->zpos = c->zlen = 0;
+	c->keys = c->restart = NULL;
+	c->nkeys = c->nrestart = 0;
+	c->nsect = c->flags = 0;
+	c->eod = 0;
+	if (c->size < 1024 || !cdb_read (c, ent, 4, 0)) {
+		return;
+	}
+	ut32_unpack (ent, &tables);
+	if (tables < 1024 || tables > c->size) {
+		return;
+	}
+	c->eod = tables;
+	/* plain files always end their records with a zero byte */
+	if (tables < 1024 + KVLSZ + CDB_EXT_FOOTER) {
+		return;
+	}
+	if (!cdb_read (c, foot, CDB_EXT_FOOTER, tables - CDB_EXT_FOOTER)) {
+		return;
+	}
+	if (memcmp (foot + 12, CDB_EXT_MAGIC, 4)) {
+		return;
+	}
+	ut32_unpack (foot, &c->eod);
+	ut32_unpack (foot + 4, &c->nsect);
+	ut32_unpack (foot + 8, &c->flags);
+	dir = tables - CDB_EXT_FOOTER - c->nsect * 12;
+	if (c->nsect > CDB_MAXSECT || c->eod < 1024 || dir < c->eod + KVLSZ || dir > tables) {
+		c->eod = tables;
+		c->nsect = c->flags = 0;
+		return;
+	}
+	for (i = 0; i < c->nsect; i++) {
+		struct cdb_sect *x = &c->sect[i];
+		if (!cdb_read (c, ent, sizeof (ent), dir + i * 12)) {
+			x->type = 0;
+			continue;
+		}
+		ut32_unpack (ent, &x->type);
+		ut32_unpack (ent + 4, &x->pos);
+		ut32_unpack (ent + 8, &x->len);
+		if (x->pos < c->eod || x->pos > dir || dir - x->pos < x->len) {
+			x->type = 0;
+		} else if (x->type == CDB_SECT_ZDATA) {
+			/* as big as the values, blocks are read when needed */
+			c->zpos = x->pos;
+			c->zlen = x->len;
+		} else if (!c->map) {
+			/* sections are small, keep them in memory */
+			c->sdata[i] = malloc (x->len + 1);
+			if (!c->sdata[i] || !cdb_read (c, c->sdata[i], x->len, x->pos)) {
+				free (c->sdata[i]);
+				c->sdata[i] = NULL;
+				x->type = 0;
+			}
+		}
+	}
+	c->zdir = (char *)cdb_section (c, CDB_SECT_ZDIR, &i);
+	c->nzblocks = c->zdir? i / 12: 0;
+	c->restart = (char *)cdb_section (c, CDB_SECT_RESTART, &i);
+	if (c->restart && i >= 8 && !((i - 8) % 8)) {
+		c->keys = (char *)cdb_section (c, CDB_SECT_KEYS, &c->keyslen);
+		ut32_unpack (c->restart, &c->nkeys);
+		ut32_unpack (c->restart + 4, &c->interval);
+		c->nrestart = (i - 8) / 8;
+		c->restart += 8;
+		if (!c->interval || c->nrestart != (c->nkeys + c->interval - 1) / c->interval) {
+			c->keys = NULL;
+		}
+	}
+	if (!c->keys) {
+		c->restart = NULL;
+		c->nkeys = c->nrestart = 0;
+	}
+}
+
+const char *cdb_section(struct cdb *c, ut32 type, ut32 *len) {
+	ut32 i;
+	for (i = 0; cdb_loaded (c) && i < c->nsect; i++) {
+		if (c->sect[i].type == type) {
+			if (len) {
+				*len = c->sect[i].len;
+			}
+			return c->map? c->map + c->sect[i].pos: c->sdata[i];
+		}
+	}
+	return NULL;
+}
+
+/* continues crc with len bytes of the file at pos, mapped or not */
+bool cdb_crc(struct cdb *c, ut32 pos, ut32 len, ut32 *crc) {
+	char tmp[4096];
+	if (pos > c->size || len > c->size - pos) {
+		return false;
+	}
+	if (c->map) {
+		*crc = sdb_crc32c (*crc, c->map + pos, len);
+		return true;
+	}
+	while (len > 0) {
+		ut32 n = R_MIN (len, sizeof (tmp));
+		if (!cdb_read (c, tmp, n, pos)) {
+			return false;
+		}
+		*crc = sdb_crc32c (*crc, tmp, n);
+		pos += n;
+		len -= n;
+	}
+	return true;
+}
+
+/* checks the record at pos against the crc section, files without one
+ * always pass */
+bool cdb_check(struct cdb *c, ut32 pos) {
+	ut32 len, lo = 0, hi, p, want, klen, vlen, crc = 0;
+	char *sect = (char *)cdb_section (c, CDB_SECT_CRC, &len);
+	if (!sect) {
+		return true;
+	}
+	hi = len / 8;
+	while (lo < hi) {
+		ut32 mid = lo + (hi - lo) / 2;
+		ut32_unpack (sect + mid * 8, &p);
+		if (p == pos) {
+			ut32_unpack (sect + mid * 8 + 4, &want);
+			if (!cdb_getkvlen (c, &klen, &vlen, pos)) {
+				return false;
+			}
+			return cdb_crc (c, pos, KVLSZ + klen + vlen, &crc) && crc == want;
+		}
+		if (p < pos) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return false;
+}
+
+/* raw bytes of block i, kept in zb for the values that follow */
+bool cdb_zblock(struct cdb *c, ut32 i, struct cdb_zbuf *zb) {
+	ut32 off, zlen, rlen, n = 0;
+	char *tmp = NULL;
+	bool ok;
+	if (zb->block == i) {
+		return true;
+	}
+	if (i >= c->nzblocks) {
+		return false;
+	}
+	ut32_unpack (c->zdir + i * 12, &off);
+	ut32_unpack (c->zdir + i * 12 + 4, &zlen);
+	ut32_unpack (c->zdir + i * 12 + 8, &rlen);
+	if (!rlen || off > c->zlen || zlen > c->zlen - off || zlen > rlen) {
+		return false;
+	}
+	if (rlen > zb->size) {
+		char *data = realloc (zb->data, rlen);
+		if (!data) {
+			return false;
+		}
+		zb->data = data;
+		zb->size = rlen;
+	}
+	zb->block = UT32_MAX;
+	if (zlen == rlen) {
+		ok = cdb_read (c, zb->data, rlen, c->zpos + off);
+	} else if (c->map) {
+		ok = sdb_lz_decompress ((const ut8 *)c->map + c->zpos + off, zlen,
+			(ut8 *)zb->data, rlen, &n) && n == rlen;
+	} else {
+		ok = (tmp = malloc (zlen)) && cdb_read (c, tmp, zlen, c->zpos + off)
+			&& sdb_lz_decompress ((const ut8 *)tmp, zlen, (ut8 *)zb->data, rlen, &n)
+			&& n == rlen;
+		free (tmp);
+	}
+	if (ok) {
+		zb->block = i;
+		zb->len = rlen;
+	}
+	return ok;
+}
+
+static bool varint(const char *buf, ut32 len, ut32 *i, ut32 *v) {
+	int shift;
+	*v = 0;
+	for (shift = 0; shift < 32 && *i < len; shift += 7) {
+		ut8 b = buf[(*i)++];
+		*v |= (ut32)(b & 0x7f) << shift;
+		if (!(b & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* the value behind a stub of len bytes, both lengths count the trailing
+ * zero. it points into the stub, into the map or into zb, which defaults
+ * to the cache of the file and stays valid until the next lookup */
+const char *cdb_zvalue(struct cdb *c, const char *stub, ut32 len, ut32 *vlen, struct cdb_zbuf *zb) {
+	ut32 i = 1, block, off, n;
+	if (len < 2 || stub[len - 1]) {
+		return NULL;
+	}
+	if (!stub[0]) {
+		*vlen = len - 1;
+		return stub + 1;
+	}
+	if (!varint (stub, len, &i, &block) || !varint (stub, len, &i, &off)
+			|| !varint (stub, len, &i, &n)) {
+		return NULL;
+	}
+	/* raw blocks of mapped files are not copied */
+	if (c->map && block < c->nzblocks) {
+		ut32 boff, zlen, rlen;
+		ut32_unpack (c->zdir + block * 12, &boff);
+		ut32_unpack (c->zdir + block * 12 + 4, &zlen);
+		ut32_unpack (c->zdir + block * 12 + 8, &rlen);
+		if (zlen == rlen && boff <= c->zlen && rlen <= c->zlen - boff) {
+			const char *data = c->map + c->zpos + boff;
+			if (off > rlen || n >= rlen - off || data[off + n]) {
+				return NULL;
+			}
+			*vlen = n + 1;
+			return data + off;
+		}
+	}
+	if (!zb) {
+		if (!c->zc) {
+			if (!(c->zc = calloc (CDB_ZCACHE, sizeof (struct cdb_zbuf)))) {
+				return NULL;
+			}
+			for (i = 0; i < CDB_ZCACHE; i++) {
+				c->zc[i].block = UT32_MAX;
+			}
+		}
+		zb = &c->zc[block % CDB_ZCACHE];
+	}
+	if (!cdb_zblock (c, block, zb) || off > zb->len || n >= zb->len - off || zb->data[off + n]) {
+		return NULL;
+	}
+	*vlen = n + 1;
+	return zb->data + off;
+}
+
+static bool krestart(struct cdb *c, struct cdb_kcur *kc, ut32 r) {
+	if (r >= c->nrestart) {
+		return false;
+	}
+	ut32_unpack (c->restart + r * 8, &kc->off);
+	ut32_unpack (c->restart + r * 8 + 4, &kc->rec);
+	kc->idx = r * c->interval;
+	kc->len = 0;
+	return true;
+}
+
+/* decodes the next key into kc, *rec gets its record */
+bool cdb_knext(struct cdb *c, struct cdb_kcur *kc, ut32 *rec) {
+	ut32 i = kc->off, shared, n, reclen;
+	if (kc->idx >= c->nkeys || kc->rec == UT32_MAX) {
+		return false;
+	}
+	if (!varint (c->keys, c->keyslen, &i, &shared) || !varint (c->keys, c->keyslen, &i, &n)) {
+		return false;
+	}
+	if (shared > kc->len || n > CDB_MAX_KEY - 1 - shared || n > c->keyslen - i) {
+		return false;
+	}
+	memcpy (kc->key + shared, c->keys + i, n);
+	kc->len = shared + n;
+	kc->key[kc->len] = 0;
+	i += n;
+	if (!varint (c->keys, c->keyslen, &i, &reclen)) {
+		return false;
+	}
+	*rec = kc->rec;
+	kc->rec += reclen;
+	kc->off = i;
+	kc->idx++;
+	return true;
+}
+
+/* key of the record at rec. kc is reused when the records are visited in
+ * order, and restarts from the closest restart point otherwise */
+const char *cdb_kat(struct cdb *c, struct cdb_kcur *kc, ut32 rec) {
+	ut32 r;
+	if (kc->rec != rec) {
+		ut32 lo = 0, hi = c->nrestart, p;
+		while (lo < hi) {
+			ut32 mid = lo + (hi - lo) / 2;
+			ut32_unpack (c->restart + mid * 8 + 4, &p);
+			if (p <= rec) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		if (!lo || !krestart (c, kc, lo - 1)) {
+			return NULL;
+		}
+		while (kc->rec < rec) {
+			if (!cdb_knext (c, kc, &r)) {
+				return NULL;
+			}
+		}
+	}
+	return (kc->rec == rec && cdb_knext (c, kc, &r))? kc->key: NULL;
+}
+
+static int kcmp(const struct cdb_kcur *kc, const char *key, ut32 len) {
+	int r = memcmp (kc->key, key, R_MIN (kc->len, len));
+	return r? r: (kc->len > len) - (kc->len < len);
+}
+
+/* index of the first key not below key, with its record in *rec and in
+ * kc->key. nkeys if there is none */
+ut32 cdb_klower(struct cdb *c, struct cdb_kcur *kc, const char *key, ut32 len, ut32 *rec) {
+	ut32 lo = 0, hi = c->nrestart, idx;
+	while (lo < hi) {
+		ut32 mid = lo + (hi - lo) / 2;
+		if (!krestart (c, kc, mid) || !cdb_knext (c, kc, rec)) {
+			return c->nkeys;
+		}
+		if (kcmp (kc, key, len) <= 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (!krestart (c, kc, lo? lo - 1: 0)) {
+		return c->nkeys;
+	}
+	for (idx = kc->idx; cdb_knext (c, kc, rec); idx++) {
+		if (kcmp (kc, key, len) >= 0) {
+			return idx;
+		}
+	}
+	return c->nkeys;
+}
+
+/* hints the kernel about the coming accesses to the map. this does not
+ * change c->advice, so scans can switch temporarily and restore it */
+void cdb_advise(struct cdb *c, int advice) {
+#if USE_MMAN
+	if (!c->map || !c->size) {
+		return;
+	}
+	if (advice & CDB_ADVICE_RANDOM) {
+		(void)posix_madvise (c->map, c->size, POSIX_MADV_RANDOM);
+	} else if (advice & CDB_ADVICE_SEQUENTIAL) {
+		(void)posix_madvise (c->map, c->size, POSIX_MADV_SEQUENTIAL);
+	} else {
+		(void)posix_madvise (c->map, c->size, POSIX_MADV_NORMAL);
+	}
+	if (advice & CDB_ADVICE_WILLNEED) {
+		(void)posix_madvise (c->map, c->size, POSIX_MADV_WILLNEED);
+	}
+#ifdef MADV_HUGEPAGE
+	if (advice & CDB_ADVICE_HUGEPAGE) {
+		/* only honored by kernels with huge pages for read-only files */
+		(void)madvise (c->map, c->size, MADV_HUGEPAGE);
+	}
+#endif
+#endif
+}
+
 bool cdb_init(struct cdb *c, int fd) {
 	struct stat st;
 	if (fd != c->fd && c->fd != -1) {
@@ -53,8 +584,40 @@ bool cdb_init(struct cdb *c, int fd) {
 	c->fd = fd;
 	cdb_findstart (c);
 	if (fd != -1 && !fstat (fd, &st) && st.st_size > 4 && st.st_size != (off_t)UT64_MAX) {
+		if (c->nomap) {
+			ut32 npages = c->npages? c->npages: CDB_PAGE_COUNT;
+			if (c->pc && c->pc->npages != npages) {
+				pcache_free (c->pc);
+				c->pc = NULL;
+			}
+			if (c->pc) {
+				pcache_reset (c->pc);
+			} else if (!(c->pc = pcache_new (npages))) {
+				eprintf ("Cannot allocate the page cache\n");
+				return false;
+			}
+			if (c->map) {
+#if USE_MMAN
+				munmap (c->map, c->size);
+#else
+				free (c->map);
+#endif
+				c->map = NULL;
+			}
+			c->size = st.st_size;
+			cdb_ext_load (c);
+			return true;
+		}
+		pcache_free (c->pc);
+		c->pc = NULL;
 #if USE_MMAN
-		char *x = mmap (0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+		if (c->advice & CDB_ADVICE_WILLNEED) {
+			flags |= MAP_POPULATE;
+		}
+#endif
+		char *x = mmap (0, st.st_size, PROT_READ, flags, fd, 0);
 		if (x == MAP_FAILED) {
 			eprintf ("Cannot mmap %d\n", (int)st.st_size);
 			return false;
@@ -65,9 +628,10 @@ bool cdb_init(struct cdb *c, int fd) {
 			eprintf ("Cannot malloc %d\n", (int)st.st_size);
 			return false;
 		}
-		/* TODO: read by chunks instead of a big huge syscall */
-		if (read (fd, x, st.st_size) != st.st_size) {
-			/* handle read error */
+		if (!cdb_pread (fd, x, st.st_size, 0)) {
+			eprintf ("Cannot read %d\n", (int)st.st_size);
+			free (x);
+			return false;
 		}
 #endif
 #if USE_MMAN
@@ -79,10 +643,15 @@ bool cdb_init(struct cdb *c, int fd) {
 #endif
 		c->map = x;
 		c->size = st.st_size;
+		if (c->advice) {
+			cdb_advise (c, c->advice);
+		}
+		cdb_ext_load (c);
 		return true;
 	}
-	c->map = NULL;
+	cdb_free (c);
 	c->size = 0;
+	c->eod = c->nsect = c->flags = 0;
 	return false;
 }
 
@@ -97,18 +666,25 @@ bool cdb_read(struct cdb *c, char *buf, ut32 len, ut32 pos) {
 		memcpy (buf, c->map + pos, len);
 		return true;
 	}
-	if (c->fd == -1 || !seek_set (c->fd, pos)) {
-		return false;
-	}
-	while (len > 0) {
-		int r = (int)read (c->fd, buf, len);
-		if (r < 1 || (ut32)r != len) {
+	if (c->pc) {
+		if (pos > c->size || c->size - pos < len || !buf) {
 			return false;
 		}
-		buf += r;
-		len -= r;
+		while (len > 0) {
+			ut32 plen, n, off = pos % CDB_PAGE_SIZE;
+			const char *page = pcache_get (c, pos / CDB_PAGE_SIZE, &plen);
+			if (!page || plen <= off) {
+				return false;
+			}
+			n = R_MIN (len, plen - off);
+			memcpy (buf, page + off, n);
+			buf += n;
+			pos += n;
+			len -= n;
+		}
+		return true;
 	}
-	return true;
+	return cdb_pread (c->fd, buf, len, pos);
 }
 
 static int match(struct cdb *c, const char *key, ut32 len, ut32 pos) {
@@ -129,54 +705,66 @@ static int match(struct cdb *c, const char *key, ut32 len, ut32 pos) {
 	return 1;
 }
 
-int cdb_findnext(struct cdb *c, ut32 u, const char *key, ut32 len) {
+int cdb_find(struct cdb *c, struct cdb_find_ctx *f, ut32 u, const char *key, ut32 len) {
 	char buf[8];
 	ut32 pos;
 	int m;
-	len++;
 	if (c->fd == -1) {
 		return -1;
 	}
-	c->hslots = 0;
-	if (!c->loop) {
+	if (cdb_sorted (c)) {
+		struct cdb_kcur kc;
+		/* keys are unique, the hash is not needed */
+		if (f->loop++ || cdb_klower (c, &kc, key, len, &pos) >= c->nkeys || kcmp (&kc, key, len)) {
+			return 0;
+		}
+		if (!cdb_getkvlen (c, &u, &f->dlen, pos) || u != 1) {
+			return -1;
+		}
+		f->dpos = pos + KVLSZ + 1;
+		return 1;
+	}
+	len++;
+	if (!f->loop) {
+		f->hslots = 0;
 		const int bufsz = ((u + 1) & 0xFF) ? sizeof (buf) : sizeof (buf) / 2;
 		if (!cdb_read (c, buf, bufsz, (u << 2) & 1023)) {
 			return -1;
 		}
 		/* hslots = (hpos_next - hpos) / 8 */
-		ut32_unpack (buf, &c->hpos);
+		ut32_unpack (buf, &f->hpos);
 		if (bufsz == sizeof (buf)) {
 			ut32_unpack (buf + 4, &pos);
 		} else {
 			pos = c->size;
 		}
-		if (pos < c->hpos) {
+		if (pos < f->hpos) {
 			return -1;
 		}
-		c->hslots = (pos - c->hpos) / (2 * sizeof (ut32));
-		if (!c->hslots) {
+		f->hslots = (pos - f->hpos) / (2 * sizeof (ut32));
+		if (!f->hslots) {
 			return 0;
 		}
-		c->khash = u;
-		u = ((u >> 8) % c->hslots) << 3;
-		c->kpos = c->hpos + u;
+		f->khash = u;
+		u = ((u >> 8) % f->hslots) << 3;
+		f->kpos = f->hpos + u;
 	}
-	while (c->loop < c->hslots) {
-		if (!cdb_read (c, buf, sizeof (buf), c->kpos)) {
+	while (f->loop < f->hslots) {
+		if (!cdb_read (c, buf, sizeof (buf), f->kpos)) {
 			return 0;
 		}
 		ut32_unpack (buf + 4, &pos);
 		if (!pos) {
 			return 0;
 		}
-		c->loop++;
-		c->kpos += sizeof (buf);
-		if (c->kpos == c->hpos + (c->hslots << 3)) {
-			c->kpos = c->hpos;
+		f->loop++;
+		f->kpos += sizeof (buf);
+		if (f->kpos == f->hpos + (f->hslots << 3)) {
+			f->kpos = f->hpos;
 		}
 		ut32_unpack (buf, &u);
-		if (u == c->khash) {
-			if (!cdb_getkvlen (c, &u, &c->dlen, pos) || !u) {
+		if (u == f->khash) {
+			if (!cdb_getkvlen (c, &u, &f->dlen, pos) || !u) {
 				return -1;
 			}
 			if (u == len) {
@@ -184,7 +772,7 @@ int cdb_findnext(struct cdb *c, ut32 u, const char *key, ut32 len) {
 					return 0;
 				}
 				if (m == 1) {
-					c->dpos = pos + KVLSZ + len;
+					f->dpos = pos + KVLSZ + len;
 					return 1;
 				}
 			}
@@ -192,3 +780,7 @@ int cdb_findnext(struct cdb *c, ut32 u, const char *key, ut32 len) {
 	}
 	return 0;
 }
+
+int cdb_findnext(struct cdb *c, ut32 u, const char *key, ut32 len) {
+	return cdb_find (c, &c->find, u, key, len);
+}
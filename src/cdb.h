@@ -12,17 +12,119 @@
 
 #define CDB_HASHSTART 5381
 
-struct cdb {
-	char *map;   /* 0 if no map is available */
-	int fd;      /* filedescriptor */
-	ut32 size;   /* initialized if map is nonzero */
+/* lookup state, owned by the caller so many lookups can run on one map */
+struct cdb_find_ctx {
 	ut32 loop;   /* number of hash slots searched under this key */
 	ut32 khash;  /* initialized if loop is nonzero */
 	ut32 kpos;   /* initialized if loop is nonzero */
 	ut32 hpos;   /* initialized if loop is nonzero */
 	ut32 hslots; /* initialized if loop is nonzero */
-	ut32 dpos;   /* initialized if cdb_findnext() returns 1 */
-	ut32 dlen;   /* initialized if cdb_findnext() returns 1 */
+	ut32 dpos;   /* initialized if cdb_find() returns 1 */
+	ut32 dlen;   /* initialized if cdb_find() returns 1 */
+};
+
+/* optional sections stored between the last record and the hash tables.
+ * they start with an empty record so plain readers stop before them, and
+ * end with a directory and a footer: eod, nsect, flags and the magic */
+#define CDB_MAXSECT 16
+#define CDB_EXT_MAGIC "sdbx"
+#define CDB_EXT_FOOTER 16
+
+#define CDB_SECT_INDEX 1 /* record offsets sorted by key */
+#define CDB_SECT_TTL 2   /* record offset and expire time, sorted by offset */
+#define CDB_SECT_CRC 3   /* record offset and crc32c of the record, sorted by offset */
+#define CDB_SECT_SUM 4   /* crc32c of the whole file, taken with these 4 bytes zeroed */
+#define CDB_SECT_ZDIR 5  /* offset, length and raw length of every value block */
+#define CDB_SECT_ZDATA 6 /* the value blocks, compressed unless both lengths match */
+#define CDB_SECT_KEYS 7  /* front coded keys of a sorted file, see cdb_make_sorted() */
+#define CDB_SECT_RESTART 8 /* key count, interval, then keys offset and record of every restart */
+
+struct cdb_sect {
+	ut32 type;
+	ut32 pos;
+	ut32 len;
+};
+
+/* access pattern hints for the map, see cdb_advise() */
+#define CDB_ADVICE_NORMAL     0
+#define CDB_ADVICE_RANDOM     1
+#define CDB_ADVICE_SEQUENTIAL 2
+#define CDB_ADVICE_WILLNEED   4 /* also prefaults the next maps */
+#define CDB_ADVICE_HUGEPAGE   8
+
+/* pages of an unmapped file, read with pread and evicted with CLOCK */
+#define CDB_PAGE_SIZE 4096
+#define CDB_PAGE_COUNT 1024 /* default capacity, 4MB */
+
+struct cdb_pcache {
+	ut32 npages;
+	ut32 hand;   /* next slot the CLOCK looks at */
+	ut32 *page;  /* page number held by each slot, UT32_MAX if free */
+	ut32 *len;   /* bytes held by each slot, short at the end of file */
+	ut32 *next;  /* slots hashed by page number, chained */
+	ut32 *head;
+	ut8 *ref;
+	char *data;
+	ut64 hits;
+	ut64 misses;
+};
+
+/* values of compressed files are stored in blocks of CDB_ZBLOCK raw bytes,
+ * records only keep a stub: a zero byte and the value, or a one and the
+ * block, offset and length of the value as varints */
+#define CDB_ZBLOCK 65536
+#define CDB_ZMIN 16    /* shorter values stay in the record */
+#define CDB_ZSTUB 16   /* longest stub */
+#define CDB_ZCACHE 8   /* blocks kept decompressed for lookups */
+
+struct cdb_zbuf {
+	char *data;
+	ut32 size;   /* allocated */
+	ut32 block;  /* block held, UT32_MAX if none */
+	ut32 len;
+};
+
+/* keys of sorted files live in CDB_SECT_KEYS in record order, records
+ * keep an empty key and there are no hash tables. every entry is the
+ * length shared with the previous key, the length and bytes of the rest
+ * and the length of its record, all but the bytes as varints. entries at
+ * restart points share nothing */
+#define CDB_RESTART 16 /* default keys per restart point */
+
+/* position in the keys, key holds the last one decoded */
+struct cdb_kcur {
+	ut32 off;  /* next entry */
+	ut32 rec;  /* record of the next entry, UT32_MAX if unknown */
+	ut32 idx;  /* number of the next entry */
+	ut32 len;
+	char key[CDB_MAX_KEY + 1];
+};
+
+struct cdb {
+	char *map;   /* 0 if no map is available */
+	int fd;      /* filedescriptor */
+	ut32 size;   /* initialized if map is nonzero */
+	ut32 eod;    /* end of the records, initialized if map is nonzero */
+	ut32 flags;  /* features used by the file */
+	ut32 nsect;
+	int advice;  /* CDB_ADVICE_* applied to every new map */
+	bool nomap;  /* serve reads through pc instead of mapping the file */
+	ut32 npages; /* pc capacity, CDB_PAGE_COUNT if 0 */
+	struct cdb_pcache *pc;
+	struct cdb_sect sect[CDB_MAXSECT];
+	char *sdata[CDB_MAXSECT]; /* sections copied to the heap if not mapped */
+	char *zdir;  /* CDB_SECT_ZDIR, 0 if values are not compressed */
+	ut32 nzblocks;
+	ut32 zpos;   /* CDB_SECT_ZDATA, never copied to the heap */
+	ut32 zlen;
+	struct cdb_zbuf *zc; /* CDB_ZCACHE blocks, hashed by number */
+	char *keys;  /* CDB_SECT_KEYS, 0 if the file has hash tables */
+	ut32 keyslen;
+	char *restart; /* CDB_SECT_RESTART pairs */
+	ut32 nrestart;
+	ut32 nkeys;
+	ut32 interval;
+	struct cdb_find_ctx find; /* used by cdb_findstart() and cdb_findnext() */
 };
 
 /* TODO THIS MUST GTFO! */
@@ -32,8 +134,27 @@ bool cdb_init(struct cdb *, int fd);
 void cdb_findstart(struct cdb *);
 bool cdb_read(struct cdb *, char *, unsigned int, ut32);
 int cdb_findnext(struct cdb *, ut32 u, const char *, ut32);
+void cdb_find_init(struct cdb_find_ctx *);
+int cdb_find(struct cdb *, struct cdb_find_ctx *, ut32 u, const char *, ut32);
+const char *cdb_section(struct cdb *, ut32 type, ut32 *len);
+bool cdb_crc(struct cdb *, ut32 pos, ut32 len, ut32 *crc);
+bool cdb_check(struct cdb *, ut32 pos);
+void cdb_advise(struct cdb *, int advice);
+bool cdb_zblock(struct cdb *, ut32 i, struct cdb_zbuf *zb);
+const char *cdb_zvalue(struct cdb *, const char *stub, ut32 len, ut32 *vlen, struct cdb_zbuf *zb);
+void cdb_zfree(struct cdb_zbuf *zb);
+bool cdb_knext(struct cdb *, struct cdb_kcur *kc, ut32 *rec);
+const char *cdb_kat(struct cdb *, struct cdb_kcur *kc, ut32 rec);
+ut32 cdb_klower(struct cdb *, struct cdb_kcur *kc, const char *key, ut32 len, ut32 *rec);
+
+/* the file is open and can be read, mapped or not */
+#define cdb_loaded(c) ((c)->map || (c)->pc)
+/* record values are stubs, see cdb_zvalue() */
+#define cdb_compressed(c) ((c)->zdir != NULL)
+/* keys are front coded and looked up without hash tables */
+#define cdb_sorted(c) ((c)->keys != NULL)
 
-#define cdb_datapos(c) ((c)->dpos)
-#define cdb_datalen(c) ((c)->dlen)
+#define cdb_datapos(c) ((c)->find.dpos)
+#define cdb_datalen(c) ((c)->find.dlen)
 
 #endif
@@ -6,8 +6,15 @@
 #include "sdb.h"
 #include "cdb.h"
 #include "cdb_make.h"
+#include "thread.h"
+#if USE_MMAN
+#include <sys/mman.h>
+#endif
 
 #define ALIGNMENT sizeof (void*)
+/* tables are only built in parallel for this many records or more */
+#define CDB_PAR_MIN 65536
+#define CDB_PAR_MAX 16
 
 char *cdb_alloc(ut32 n) {
 #if __APPLE__ && !__POWERPC__
@@ -36,9 +43,21 @@ int cdb_make_start(struct cdb_make *c, int fd) {
 	int i;
 	c->head = 0;
 	c->split = 0;
-	c->hash = 0;
 	c->numentries = 0;
 	c->fd = fd;
+	c->eod = c->flags = c->nsect = 0;
+	c->spill = -1;
+	c->hplimit = c->nhp = c->nruns = 0;
+	c->runs = NULL;
+	c->w = NULL;
+	c->bufx = NULL;
+	c->bufsize = 0;
+	c->bown = false;
+	c->crc = false;
+	c->crcs = NULL;
+	c->ncrc = c->mcrc = 0;
+	c->z = NULL;
+	c->k = NULL;
 	c->pos = sizeof (c->final);
 	buffer_init (&c->b, (BufferOp)write, fd, c->bspace, sizeof (c->bspace));
 	c->memsize = 1;
@@ -57,6 +76,842 @@ static inline int incpos(struct cdb_make *c, ut32 len) {
 	return 1;
 }
 
+/* records are added in order, so the crc section comes out sorted */
+static int cdb_make_addcrc(struct cdb_make *c, ut32 crc) {
+	if (c->ncrc == c->mcrc) {
+		ut32 m = c->mcrc? c->mcrc * 2: 1024;
+		char *crcs = (m > UT32_MAX / 8)? NULL: realloc (c->crcs, m * 8);
+		if (!crcs) {
+			return 0;
+		}
+		c->crcs = crcs;
+		c->mcrc = m;
+	}
+	ut32_pack (c->crcs + c->ncrc * 8, c->pos);
+	ut32_pack (c->crcs + c->ncrc * 8 + 4, crc);
+	c->ncrc++;
+	return 1;
+}
+
+static void cdb_make_freelist(struct cdb_make *c) {
+	struct cdb_hplist *x, *n;
+	for (x = c->head; x;) {
+		n = x->next;
+		cdb_alloc_free (x);
+		x = n;
+	}
+	c->head = NULL;
+	c->nhp = 0;
+}
+
+static int writeall(int fd, const char *buf, ut64 len) {
+	while (len > 0) {
+		ssize_t n = write (fd, buf, len > 0x10000000? 0x10000000: len);
+		if (n < 1) {
+			return 0;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 1;
+}
+
+static int readall(int fd, char *buf, ut64 len) {
+	while (len > 0) {
+		ssize_t n = read (fd, buf, len > 0x10000000? 0x10000000: len);
+		if (n < 1) {
+			return 0;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 1;
+}
+
+static int pwriteall(int fd, const char *buf, ut32 len, ut32 off) {
+#if __SDB_WINDOWS__
+	return seek_set (fd, off) && writeall (fd, buf, len);
+#else
+	while (len > 0) {
+		ssize_t n = pwrite (fd, buf, len, off);
+		if (n < 1) {
+			return 0;
+		}
+		buf += n;
+		len -= n;
+		off += n;
+	}
+	return 1;
+#endif
+}
+
+static void cdb_make_bufreset(struct cdb_make *c) {
+	if (c->bufx) {
+		buffer_init (&c->b, (BufferOp)write, c->fd, c->bufx, c->bufsize);
+	} else {
+		buffer_init (&c->b, (BufferOp)write, c->fd, c->bspace, sizeof (c->bspace));
+	}
+}
+
+/* records are staged in size bytes at buf, or on the heap if buf is NULL,
+ * instead of the 8K bspace. values that do not fit go straight to the
+ * file. buf must stay around until c is freed */
+int cdb_make_buffer(struct cdb_make *c, char *buf, ut32 size) {
+	char *x = buf;
+	if (c->w || size < KVLSZ || !buffer_flush (&c->b)) {
+		return 0;
+	}
+	if (!x && !(x = cdb_alloc (size))) {
+		return 0;
+	}
+	if (c->bown) {
+		cdb_alloc_free (c->bufx);
+	}
+	c->bufx = x;
+	c->bufsize = size;
+	c->bown = !buf;
+	cdb_make_bufreset (c);
+	return 1;
+}
+
+/* buffers cycle between the two queues: filled ones go to the thread,
+ * which writes them at their offset and hands them back */
+struct cdb_wbuf {
+	char *data;
+	ut32 len;
+	ut32 off;
+};
+
+struct cdb_writer {
+	SdbThread *th;
+	SdbQueue *todo; /* NULL stops the thread */
+	SdbQueue *done;
+	struct cdb_wbuf *bufs;
+	struct cdb_wbuf *cur;
+	ut32 nbufs;
+	ut32 size;
+	ut32 off;
+	int fd;
+	int failed; // see sdb_th_load
+};
+
+static void cdb_writer_main(void *user, int idx) {
+	struct cdb_writer *w = user;
+	struct cdb_wbuf *b;
+	(void)idx; // a single writer
+	while ((b = sdb_queue_pop (w->todo))) {
+		if (!sdb_th_load (w->failed) && !pwriteall (w->fd, b->data, b->len, b->off)) {
+			sdb_th_store (w->failed, 1);
+		}
+		sdb_queue_push (w->done, b);
+	}
+}
+
+static char *cdb_writer_swap(void *user, char *data, ut32 len) {
+	struct cdb_writer *w = user;
+	struct cdb_wbuf *b = w->cur;
+	(void)data; // the buffer of w->cur
+	b->len = len;
+	b->off = w->off;
+	w->off += len;
+	sdb_queue_push (w->todo, b);
+	w->cur = sdb_queue_pop (w->done);
+	return sdb_th_load (w->failed)? NULL: w->cur->data;
+}
+
+static void cdb_writer_free(struct cdb_writer *w) {
+	ut32 i;
+	if (w->bufs) {
+		for (i = 0; i < w->nbufs; i++) {
+			cdb_alloc_free (w->bufs[i].data);
+		}
+	}
+	free (w->bufs);
+	sdb_queue_free (w->todo);
+	sdb_queue_free (w->done);
+	free (w);
+}
+
+/* waits for the writes in flight, the buffers being written are all
+ * taken back from the thread and returned */
+static int cdb_writer_drain(struct cdb_writer *w) {
+	struct cdb_wbuf *b[256];
+	ut32 i, n = w->nbufs - 1;
+	for (i = 0; i < n; i++) {
+		b[i] = sdb_queue_pop (w->done);
+	}
+	for (i = 0; i < n; i++) {
+		sdb_queue_push (w->done, b[i]);
+	}
+	return !sdb_th_load (w->failed);
+}
+
+/* stops the thread, what was not flushed is lost. writes continue from
+ * the file position */
+static void cdb_writer_stop(struct cdb_make *c) {
+	struct cdb_writer *w = c->w;
+	if (!w) {
+		return;
+	}
+	sdb_queue_push (w->todo, NULL);
+	sdb_th_join (w->th);
+	seek_set (c->fd, w->off);
+	cdb_make_bufreset (c);
+	cdb_writer_free (w);
+	c->w = NULL;
+}
+
+/* data is written in nbufs buffers of size bytes from another thread,
+ * so building the records overlaps with the writes. nothing changes
+ * if threads are not available */
+int cdb_make_async(struct cdb_make *c, ut32 nbufs, ut32 size) {
+	struct cdb_writer *w;
+	ut32 i;
+	if (c->w) {
+		return 1;
+	}
+	if (nbufs < 2 || nbufs > 256 || size < sizeof (c->bspace) || !buffer_flush (&c->b)) {
+		return 0;
+	}
+	w = R_NEW0 (struct cdb_writer);
+	if (!w) {
+		return 0;
+	}
+	w->nbufs = nbufs;
+	w->size = size;
+	w->fd = c->fd;
+	w->off = c->pos;
+	w->bufs = calloc (nbufs, sizeof (struct cdb_wbuf));
+	w->todo = sdb_queue_new (nbufs);
+	w->done = sdb_queue_new (nbufs);
+	if (!w->bufs || !w->todo || !w->done) {
+		cdb_writer_free (w);
+		return 0;
+	}
+	for (i = 0; i < nbufs; i++) {
+		if (!(w->bufs[i].data = cdb_alloc (size))) {
+			cdb_writer_free (w);
+			return 0;
+		}
+	}
+	for (i = 1; i < nbufs; i++) {
+		sdb_queue_push (w->done, &w->bufs[i]);
+	}
+	w->cur = &w->bufs[0];
+	if (!(w->th = sdb_th_new (cdb_writer_main, w))) {
+		cdb_writer_free (w);
+		return 0;
+	}
+	c->w = w;
+	buffer_init (&c->b, (BufferOp)write, c->fd, w->cur->data, size);
+	buffer_swap (&c->b, cdb_writer_swap, w);
+	return 1;
+}
+
+/* everything added so far is in the file */
+int cdb_make_flush(struct cdb_make *c) {
+	if (!buffer_flush (&c->b)) {
+		return 0;
+	}
+	return c->w? cdb_writer_drain (c->w): 1;
+}
+
+/* moves the pairs in memory to the spill file as one run, grouped by table */
+static int cdb_make_flushrun(struct cdb_make *c) {
+	ut32 start[256], *counts, *runs, i, u;
+	struct cdb_hplist *x;
+	struct cdb_hp *run;
+	int ret;
+	if (!c->nhp) {
+		return 1;
+	}
+	runs = realloc (c->runs, (c->nruns + 1) * 256 * sizeof (ut32));
+	if (!runs) {
+		return 0;
+	}
+	c->runs = runs;
+	counts = runs + c->nruns * 256;
+	memset (counts, 0, 256 * sizeof (ut32));
+	for (x = c->head; x; x = x->next) {
+		for (i = 0; i < (ut32)x->num; i++) {
+			counts[255 & x->hp[i].h]++;
+		}
+	}
+	for (u = i = 0; i < 256; i++) {
+		u += counts[i];
+		start[i] = u;
+	}
+	run = (struct cdb_hp *) cdb_alloc (c->nhp * sizeof (struct cdb_hp));
+	if (!run) {
+		return 0;
+	}
+	/* the list is newest first, fill backwards to keep the insertion order */
+	for (x = c->head; x; x = x->next) {
+		i = x->num;
+		while (i--) {
+			run[--start[255 & x->hp[i].h]] = x->hp[i];
+		}
+	}
+	ret = writeall (c->spill, (const char *)run, (ut64)c->nhp * sizeof (struct cdb_hp));
+	cdb_alloc_free (run);
+	if (ret) {
+		c->nruns++;
+		cdb_make_freelist (c);
+	}
+	return ret;
+}
+
+/* read-only view of the first size bytes written to fd */
+char *cdb_make_map(int fd, ut32 size) {
+#if USE_MMAN
+	char *map = mmap (NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	return map == MAP_FAILED? NULL: map;
+#else
+	char *map = malloc (size);
+	if (!map || !seek_set (fd, 0) || !readall (fd, map, size)) {
+		free (map);
+		return NULL;
+	}
+	return map;
+#endif
+}
+
+void cdb_make_unmap(int fd, char *map, ut32 size) {
+#if USE_MMAN
+	(void)fd; // only the copy below moves the file position
+	munmap (map, size);
+#else
+	free (map);
+	// the writer keeps appending at the end
+	seek_set (fd, size);
+#endif
+}
+
+static int hp_old_cmp(const void *a, const void *b) {
+	ut32 x = ((const struct cdb_hp *)a)->h, y = ((const struct cdb_hp *)b)->h;
+	return x < y? -1: x > y;
+}
+
+/* copies the records added so far to fd, grouped by hash table and sorted
+ * by home slot, so a page of a table points into a few pages of records.
+ * moved gets (old, new) positions sorted by the old one, to be freed by the
+ * caller. c continues on fd, and is left untouched if that fails early */
+int cdb_make_cluster(struct cdb_make *c, int fd, struct cdb_hp **moved) {
+	ut32 i, j, u, n = c->numentries, size = c->pos;
+	ut32 start[256], *slots = NULL;
+	int ofd = c->fd;
+	struct cdb_hp *hp = NULL, *order = NULL;
+	struct cdb_hplist *x;
+	char *map = NULL;
+	int ret = 0;
+	ut32 nbufs = c->w? c->w->nbufs: 0;
+	ut32 bsize = c->w? c->w->size: 0;
+	char *ubuf = c->bown? NULL: c->bufx;
+	ut32 usize = c->bufsize;
+	bool crc = c->crc;
+	struct cdb_zwriter *z = c->z;
+
+	*moved = NULL;
+	if (c->nsect || c->spill != -1 || !cdb_make_flush (c)) {
+		return 0;
+	}
+	if (n > UT32_MAX / sizeof (struct cdb_hp) || c->memsize > UT32_MAX / sizeof (ut32) - 1) {
+		return 0;
+	}
+	hp = malloc ((n? n: 1) * sizeof (struct cdb_hp));
+	order = (struct cdb_hp *) cdb_alloc ((n? n: 1) * sizeof (struct cdb_hp));
+	slots = (ut32 *) cdb_alloc ((c->memsize + 1) * sizeof (ut32));
+	if (!hp || !order || !slots || (n && !(map = cdb_make_map (c->fd, size)))) {
+		goto beach;
+	}
+	/* by table, in insertion order. the list is newest first */
+	for (u = i = 0; i < 256; i++) {
+		u += c->count[i];
+		start[i] = u;
+	}
+	for (x = c->head; x; x = x->next) {
+		j = x->num;
+		while (j--) {
+			hp[--start[255 & x->hp[j].h]] = x->hp[j];
+		}
+	}
+	/* then by the home slot of each table, a stable counting sort */
+	for (i = 0; i < 256; i++) {
+		ut32 count = c->count[i], len = count << 1;
+		struct cdb_hp *t = hp + start[i], *o = order + start[i];
+		if (!count) {
+			continue;
+		}
+		memset (slots, 0, (len + 1) * sizeof (ut32));
+		for (u = 0; u < count; u++) {
+			slots[(t[u].h >> 8) % len + 1]++;
+		}
+		for (u = 0; u < len; u++) {
+			slots[u + 1] += slots[u];
+		}
+		for (u = 0; u < count; u++) {
+			o[slots[(t[u].h >> 8) % len]++] = t[u];
+		}
+	}
+	/* records are copied with their stubs, the blocks stay valid */
+	c->z = NULL;
+	cdb_make_free (c);
+	i = cdb_make_start (c, fd);
+	c->z = z;
+	if (!i) {
+		goto beach;
+	}
+	if (usize) {
+		cdb_make_buffer (c, ubuf, usize);
+	}
+	c->crc = crc;
+	if (nbufs) {
+		cdb_make_async (c, nbufs, bsize);
+	}
+	for (u = 0; u < n; u++) {
+		const ut8 *rec = (const ut8 *)map + order[u].p;
+		ut32 klen = rec[0];
+		ut32 vlen = rec[1] | (rec[2] << 8) | ((ut32)rec[3] << 16);
+		ut32 pos = c->pos, len = KVLSZ + klen + vlen;
+		if (crc && !cdb_make_addcrc (c, sdb_crc32c (0, rec, len))) {
+			goto beach;
+		}
+		if (len >= c->b.n) {
+			if (!buffer_putdirect (&c->b, (const char *)rec, len)) {
+				goto beach;
+			}
+		} else if (!buffer_putalign (&c->b, (const char *)rec, len)) {
+			goto beach;
+		}
+		if (!cdb_make_addend (c, klen, vlen, order[u].h)) {
+			goto beach;
+		}
+		order[u].h = order[u].p;
+		order[u].p = pos;
+	}
+	/* new positions grow with u, sort back by the old ones */
+	for (u = 0; u < n; u++) {
+		hp[u] = order[u];
+	}
+	qsort (hp, n, sizeof (struct cdb_hp), hp_old_cmp);
+	*moved = hp;
+	hp = NULL;
+	ret = 1;
+beach:
+	if (map) {
+		cdb_make_unmap (ofd, map, size);
+	}
+	free (hp);
+	if (order) {
+		cdb_alloc_free (order);
+	}
+	if (slots) {
+		cdb_alloc_free (slots);
+	}
+	return ret;
+}
+
+/* keep at most limit (hash,pos) pairs in memory, the rest goes to fd */
+int cdb_make_spill(struct cdb_make *c, int fd, ut32 limit) {
+	if (fd == -1 || !limit) {
+		return 0;
+	}
+	c->spill = fd;
+	c->hplimit = limit;
+	return 1;
+}
+
+/* values waiting to be compressed, see cdb_make_compress */
+struct cdb_zwriter {
+	int fd;
+	ut32 bsize;
+	char *raw;  // block being filled
+	ut32 rawlen;
+	ut32 rawcap;
+	char *out;
+	ut32 outcap;
+	char *dir;  // (offset, length, raw length) of the blocks written
+	ut32 nblocks;
+	ut32 mblocks;
+	ut32 off;   // bytes written to fd
+	bool lz;    // blocks are stored raw unless set, see cdb_make_compress
+	/* values interned by cdb_make_dedup, open addressing on their crc32c */
+	struct cdb_zdup *dup;
+	ut32 ndup;
+	ut32 mdup;
+	char *pool; // bytes of the interned values
+	ut32 plen;
+	ut32 pcap;
+};
+
+struct cdb_zdup {
+	ut32 hash;
+	ut32 val;   // offset in the pool
+	ut32 len;   // 0 if the slot is free
+	ut32 block;
+	ut32 off;
+};
+
+/* values of CDB_ZMIN bytes or more are gathered in blocks of about bsize
+ * bytes, compressed and written to fd until cdb_make_finish copies them
+ * into the file. must be called before the first record */
+static int cdb_zwriter_new(struct cdb_make *c, int fd, ut32 bsize) {
+	if (c->z) {
+		return c->z->fd == fd && c->z->bsize == bsize;
+	}
+	if (fd == -1 || !bsize || c->numentries) {
+		return 0;
+	}
+	if (!(c->z = calloc (1, sizeof (struct cdb_zwriter)))) {
+		return 0;
+	}
+	c->z->fd = fd;
+	c->z->bsize = bsize;
+	return 1;
+}
+
+int cdb_make_compress(struct cdb_make *c, int fd, ut32 bsize) {
+	if (!cdb_zwriter_new (c, fd, bsize)) {
+		return 0;
+	}
+	c->z->lz = true;
+	return 1;
+}
+
+/* values of CDB_ZMIN to CDB_DUPMAX bytes are interned, the records of
+ * later copies point to the first one in its block. values go to blocks
+ * as with cdb_make_compress, which may be called before or after, but
+ * the blocks stay raw without it so mapped files read them in place */
+int cdb_make_dedup(struct cdb_make *c, int fd, ut32 bsize) {
+	if (!cdb_zwriter_new (c, fd, bsize)) {
+		return 0;
+	}
+	if (!c->z->dup) {
+		if (!(c->z->dup = calloc (1024, sizeof (struct cdb_zdup)))) {
+			return 0;
+		}
+		c->z->mdup = 1024;
+	}
+	return 1;
+}
+
+static void cdb_zwriter_free(struct cdb_zwriter *z) {
+	if (z) {
+		free (z->raw);
+		free (z->out);
+		free (z->dir);
+		free (z->dup);
+		free (z->pool);
+		free (z);
+	}
+}
+
+static int cdb_zwriter_flush(struct cdb_zwriter *z) {
+	const char *data = z->raw;
+	ut32 zlen;
+	if (!z->rawlen) {
+		return 1;
+	}
+	if (z->lz && z->outcap < z->rawlen) {
+		char *out = realloc (z->out, z->rawlen);
+		if (!out) {
+			return 0;
+		}
+		z->out = out;
+		z->outcap = z->rawlen;
+	}
+	/* blocks that do not shrink are stored as they are */
+	zlen = z->lz? sdb_lz_compress ((const ut8 *)z->raw, z->rawlen, (ut8 *)z->out, z->rawlen - 1): 0;
+	if (zlen) {
+		data = z->out;
+	} else {
+		zlen = z->rawlen;
+	}
+	if (z->off > UT32_MAX - zlen || !writeall (z->fd, data, zlen)) {
+		return 0;
+	}
+	if (z->nblocks == z->mblocks) {
+		ut32 m = z->mblocks? z->mblocks * 2: 64;
+		char *dir = (m > UT32_MAX / 12)? NULL: realloc (z->dir, m * 12);
+		if (!dir) {
+			return 0;
+		}
+		z->dir = dir;
+		z->mblocks = m;
+	}
+	ut32_pack (z->dir + z->nblocks * 12, z->off);
+	ut32_pack (z->dir + z->nblocks * 12 + 4, zlen);
+	ut32_pack (z->dir + z->nblocks * 12 + 8, z->rawlen);
+	z->nblocks++;
+	z->off += zlen;
+	z->rawlen = 0;
+	return 1;
+}
+
+static ut32 putvarint(char *buf, ut32 v) {
+	ut32 n = 0;
+	for (; v >= 0x80; v >>= 7) {
+		buf[n++] = (char)((v & 0x7f) | 0x80);
+	}
+	buf[n++] = (char)v;
+	return n;
+}
+
+static ut32 cdb_zstub(char *stub, ut32 block, ut32 off, ut32 len) {
+	ut32 n = 1;
+	stub[0] = 1;
+	n += putvarint (stub + n, block);
+	n += putvarint (stub + n, off);
+	n += putvarint (stub + n, len);
+	return n;
+}
+
+/* the slot of data in the dup table, a free one if it was not interned */
+static struct cdb_zdup *cdb_zdup_find(struct cdb_zwriter *z, const char *data, ut32 len, ut32 hash) {
+	ut32 i = hash & (z->mdup - 1);
+	for (;;) {
+		struct cdb_zdup *d = &z->dup[i];
+		if (!d->len || (d->hash == hash && d->len == len && !memcmp (z->pool + d->val, data, len))) {
+			return d;
+		}
+		i = (i + 1) & (z->mdup - 1);
+	}
+}
+
+/* remembers where the first copy of data went. values no longer fit once
+ * the pool is full, they are just stored again */
+static bool cdb_zdup_add(struct cdb_zwriter *z, struct cdb_zdup *d, const char *data, ut32 len, ut32 hash, ut32 block, ut32 off) {
+	ut32 i;
+	if (len > CDB_DUPPOOL - z->plen) {
+		return true;
+	}
+	if (z->plen + len > z->pcap) {
+		ut32 m = R_MAX (z->pcap * 2, 65536);
+		char *pool = realloc (z->pool, R_MIN (m, CDB_DUPPOOL));
+		if (!pool) {
+			return false;
+		}
+		z->pool = pool;
+		z->pcap = R_MIN (m, CDB_DUPPOOL);
+	}
+	d->hash = hash;
+	d->val = z->plen;
+	d->len = len;
+	d->block = block;
+	d->off = off;
+	memcpy (z->pool + z->plen, data, len);
+	z->plen += len;
+	/* rehashed at 3/4 */
+	if (++z->ndup * 4 < z->mdup * 3) {
+		return true;
+	}
+	struct cdb_zdup *old = z->dup;
+	ut32 m = z->mdup;
+	if (!(z->dup = calloc (m * 2, sizeof (struct cdb_zdup)))) {
+		z->dup = old;
+		return false;
+	}
+	z->mdup = m * 2;
+	for (i = 0; i < m; i++) {
+		if (old[i].len) {
+			*cdb_zdup_find (z, z->pool + old[i].val, old[i].len, old[i].hash) = old[i];
+		}
+	}
+	free (old);
+	return true;
+}
+
+/* fills the stub of a value and returns its length. short values follow
+ * their stub in the record, the others are moved to the current block */
+static ut32 cdb_zwriter_add(struct cdb_zwriter *z, const char *data, ut32 datalen, char *stub) {
+	ut32 n, need = datalen + 1, hash = 0;
+	struct cdb_zdup *d = NULL;
+	if (datalen < CDB_ZMIN) {
+		stub[0] = 0;
+		return 1;
+	}
+	if (z->dup && datalen <= CDB_DUPMAX) {
+		hash = sdb_crc32c (0, data, datalen);
+		d = cdb_zdup_find (z, data, datalen, hash);
+		if (d->len) {
+			return cdb_zstub (stub, d->block, d->off, datalen);
+		}
+	}
+	if (z->rawlen && z->rawlen + need > z->bsize && !cdb_zwriter_flush (z)) {
+		return 0;
+	}
+	if (z->rawlen + need > z->rawcap) {
+		ut32 m = R_MAX (z->bsize, z->rawlen + need);
+		char *raw = realloc (z->raw, m);
+		if (!raw) {
+			return 0;
+		}
+		z->raw = raw;
+		z->rawcap = m;
+	}
+	n = cdb_zstub (stub, z->nblocks, z->rawlen, datalen);
+	if (d && !cdb_zdup_add (z, d, data, datalen, hash, z->nblocks, z->rawlen)) {
+		return 0;
+	}
+	memcpy (z->raw + z->rawlen, data, datalen);
+	z->raw[z->rawlen + datalen] = 0;
+	z->rawlen += need;
+	if (z->rawlen >= z->bsize && !cdb_zwriter_flush (z)) {
+		return 0;
+	}
+	return n;
+}
+
+/* the last block, then every block as two sections */
+static int cdb_make_zsections(struct cdb_make *c) {
+	struct cdb_zwriter *z = c->z;
+	char *map = NULL;
+	int ret;
+	if (!cdb_zwriter_flush (z)) {
+		return 0;
+	}
+	if (!cdb_make_section (c, CDB_SECT_ZDIR, z->nblocks? z->dir: "", z->nblocks * 12)) {
+		return 0;
+	}
+	if (z->off && !(map = cdb_make_map (z->fd, z->off))) {
+		return 0;
+	}
+	ret = cdb_make_section (c, CDB_SECT_ZDATA, map? map: "", z->off);
+	if (map) {
+		cdb_make_unmap (z->fd, map, z->off);
+	}
+	return ret;
+}
+
+/* keys of a sorted file, see CDB_SECT_KEYS */
+struct cdb_kwriter {
+	ut32 interval;
+	ut32 count;
+	char *keys;
+	ut32 len;
+	ut32 cap;
+	char *restart; // count and interval, then (keys offset, record) pairs
+	ut32 rlen;
+	ut32 rcap;
+	ut32 lastlen;
+	char last[CDB_MAX_KEY + 1];
+};
+
+/* keys must then come in strictly ascending order. they are front coded
+ * in a section and records keep an empty key, lookups binary search the
+ * restart points every interval keys so no hash tables are written.
+ * must be called before the first record */
+int cdb_make_sorted(struct cdb_make *c, ut32 interval) {
+	if (!interval || c->numentries || c->k || c->pos != sizeof (c->final)) {
+		return 0;
+	}
+	if (!(c->k = calloc (1, sizeof (struct cdb_kwriter)))) {
+		return 0;
+	}
+	c->k->interval = interval;
+	c->k->rlen = 8;
+	return 1;
+}
+
+static void cdb_kwriter_free(struct cdb_kwriter *k) {
+	if (k) {
+		free (k->keys);
+		free (k->restart);
+		free (k);
+	}
+}
+
+static int kgrow(char **buf, ut32 *cap, ut32 need) {
+	if (need > *cap) {
+		ut32 m = R_MAX (need, *cap? *cap * 2: 4096);
+		char *b = realloc (*buf, m);
+		if (!b) {
+			return 0;
+		}
+		*buf = b;
+		*cap = m;
+	}
+	return 1;
+}
+
+static int cdb_kwriter_ordered(struct cdb_kwriter *k, const char *key, ut32 keylen) {
+	int r;
+	if (!k->count) {
+		return 1;
+	}
+	r = memcmp (k->last, key, R_MIN (k->lastlen, keylen));
+	return r < 0 || (!r && k->lastlen < keylen);
+}
+
+static int cdb_kwriter_add(struct cdb_kwriter *k, const char *key, ut32 keylen, ut32 rec, ut32 reclen) {
+	ut32 shared = 0;
+	if (keylen >= CDB_MAX_KEY || k->len > UT32_MAX - keylen - 16) {
+		return 0;
+	}
+	if (!(k->count % k->interval)) {
+		if (!kgrow (&k->restart, &k->rcap, k->rlen + 8)) {
+			return 0;
+		}
+		ut32_pack (k->restart + k->rlen, k->len);
+		ut32_pack (k->restart + k->rlen + 4, rec);
+		k->rlen += 8;
+	} else {
+		while (shared < k->lastlen && shared < keylen && k->last[shared] == key[shared]) {
+			shared++;
+		}
+	}
+	if (!kgrow (&k->keys, &k->cap, k->len + keylen + 16)) {
+		return 0;
+	}
+	k->len += putvarint (k->keys + k->len, shared);
+	k->len += putvarint (k->keys + k->len, keylen - shared);
+	memcpy (k->keys + k->len, key + shared, keylen - shared);
+	k->len += keylen - shared;
+	k->len += putvarint (k->keys + k->len, reclen);
+	memcpy (k->last, key, keylen);
+	k->lastlen = keylen;
+	k->count++;
+	return 1;
+}
+
+static int cdb_make_ksections(struct cdb_make *c) {
+	struct cdb_kwriter *k = c->k;
+	if (!kgrow (&k->restart, &k->rcap, 8)) {
+		return 0;
+	}
+	ut32_pack (k->restart, k->count);
+	ut32_pack (k->restart + 4, k->interval);
+	return cdb_make_section (c, CDB_SECT_KEYS, k->len? k->keys: "", k->len)
+		&& cdb_make_section (c, CDB_SECT_RESTART, k->restart, k->rlen);
+}
+
+/* reads the pairs of table i from every run */
+static int cdb_make_readtable(struct cdb_make *c, ut32 i, struct cdb_hp *hp) {
+	ut64 base = 0;
+	ut32 r, j;
+	for (r = 0; r < c->nruns; r++) {
+		const ut32 *counts = c->runs + r * 256;
+		ut64 off = base;
+		for (j = 0; j < i; j++) {
+			off += counts[j];
+		}
+		if (counts[i]) {
+			if (!seek_set (c->spill, off * sizeof (struct cdb_hp))) {
+				return 0;
+			}
+			if (!readall (c->spill, (char *)hp, (ut64)counts[i] * sizeof (struct cdb_hp))) {
+				return 0;
+			}
+			hp += counts[i];
+		}
+		for (; j < 256; j++) {
+			off += counts[j];
+		}
+		base = off;
+	}
+	return 1;
+}
+
 #define R_ANEW(x) (x*)cdb_alloc(sizeof(x))
 int cdb_make_addend(struct cdb_make *c, ut32 keylen, ut32 datalen, ut32 h) {
 	ut32 u;
@@ -72,12 +927,16 @@ int cdb_make_addend(struct cdb_make *c, ut32 keylen, ut32 datalen, ut32 h) {
 	head->hp[head->num].h = h;
 	head->hp[head->num].p = c->pos;
 	head->num++;
+	c->nhp++;
 	c->numentries++;
 	c->count[255 & h] ++;
 	u = c->count[255 & h] * 2;
 	if (u > c->memsize) {
 		c->memsize = u;
 	}
+	if (c->spill != -1 && c->nhp >= c->hplimit && !cdb_make_flushrun (c)) {
+		return 0;
+	}
 	return incpos (c, KVLSZ + keylen + datalen);
 }
 
@@ -97,98 +956,347 @@ static int pack_kvlen(ut8 *buf, ut32 klen, ut32 vlen) {
 
 int cdb_make_addbegin(struct cdb_make *c, ut32 keylen, ut32 datalen) {
 	ut8 buf[KVLSZ];
+	if (c->nsect) {
+		return 0; // records must go before the sections
+	}
 	if (!pack_kvlen (buf, keylen, datalen)) {
 		return 0;
 	}
 	return buffer_putalign (&c->b, (const char *)buf, KVLSZ);
 }
 
+/* keep a crc32c of every record and of the whole file. records added
+ * with cdb_make_addbegin/addend are not covered, so it must be called
+ * before the first one */
+int cdb_make_checksum(struct cdb_make *c) {
+	if (c->numentries) {
+		return 0;
+	}
+	c->crc = true;
+	return 1;
+}
+
 int cdb_make_add(struct cdb_make *c, const char *key, ut32 keylen, const char *data, ut32 datalen) {
-	/* add tailing \0 to allow mmap to work later */
-	keylen++;
-	datalen++;
-	if (!cdb_make_addbegin (c, keylen, datalen)) {
+	char stub[CDB_ZSTUB];
+	ut32 slen = 0;
+	if (c->k && (c->nsect || !cdb_kwriter_ordered (c->k, key, keylen))) {
 		return 0;
 	}
-	if (!buffer_putalign (&c->b, key, keylen)) {
+	if (c->z) {
+		/* records of compressed files keep a stub, see cdb_zvalue */
+		if (c->nsect || datalen + 1 >= SDB_MAX_VALUE) {
+			return 0;
+		}
+		if (!(slen = cdb_zwriter_add (c->z, data, datalen, stub))) {
+			return 0;
+		}
+		if (stub[0]) {
+			datalen = 0;
+		}
+	}
+	if (c->k) {
+		/* the key goes to the keys section, the record keeps "" */
+		if (!cdb_kwriter_add (c->k, key, keylen, c->pos, KVLSZ + 1 + slen + datalen + 1)) {
+			return 0;
+		}
+		key = "";
+		keylen = 0;
+	}
+	/* add tailing \0 to allow mmap to work later, data may be binary */
+	if (!cdb_make_addbegin (c, keylen + 1, slen + datalen + 1)) {
 		return 0;
 	}
-	if (!buffer_putalign (&c->b, data, datalen)) {
+	if (c->crc) {
+		ut8 kv[KVLSZ];
+		ut32 crc;
+		pack_kvlen (kv, keylen + 1, slen + datalen + 1);
+		crc = sdb_crc32c (0, kv, KVLSZ);
+		crc = sdb_crc32c (crc, key, keylen);
+		crc = sdb_crc32c (crc, "", 1);
+		crc = sdb_crc32c (crc, stub, slen);
+		crc = sdb_crc32c (crc, data, datalen);
+		if (!cdb_make_addcrc (c, sdb_crc32c (crc, "", 1))) {
+			return 0;
+		}
+	}
+	if (!buffer_putalign (&c->b, key, keylen) || !buffer_putalign (&c->b, "", 1)) {
 		return 0;
 	}
-	return cdb_make_addend (c, keylen, datalen, sdb_hash (key));
+	if (slen && !buffer_putalign (&c->b, stub, slen)) {
+		return 0;
+	}
+	/* large values are not copied, see cdb_make_buffer */
+	if (datalen >= c->b.n) {
+		if (!buffer_putdirect (&c->b, data, datalen)) {
+			return 0;
+		}
+	} else if (!buffer_putalign (&c->b, data, datalen)) {
+		return 0;
+	}
+	if (!buffer_putalign (&c->b, "", 1)) {
+		return 0;
+	}
+	if (c->k) {
+		return incpos (c, KVLSZ + 1 + slen + datalen + 1);
+	}
+	return cdb_make_addend (c, keylen + 1, slen + datalen + 1, sdb_hash (key));
 }
 
-int cdb_make_finish(struct cdb_make *c) {
-	int i;
-	char buf[8];
-	struct cdb_hp *hp;
-	struct cdb_hplist *x, *n;
-	ut32 len, u, memsize, count, where;
+int cdb_make_section(struct cdb_make *c, ut32 type, const char *data, ut32 len) {
+	char buf[KVLSZ] = {0};
+	struct cdb_sect *x;
+	if (c->nsect >= CDB_MAXSECT || !data) {
+		return 0;
+	}
+	if (!c->nsect) {
+		/* empty record, stops the iterators at the end of the data */
+		c->eod = c->pos;
+		if (!buffer_putalign (&c->b, buf, sizeof (buf)) || !incpos (c, sizeof (buf))) {
+			return 0;
+		}
+	}
+	x = &c->sect[c->nsect++];
+	x->type = type;
+	x->pos = c->pos;
+	x->len = len;
+	if (len && !buffer_putalign (&c->b, data, len)) {
+		return 0;
+	}
+	return incpos (c, len);
+}
 
-	memsize = c->memsize + c->numentries;
-	if (memsize > (UT32_MAX / sizeof (struct cdb_hp))) {
+static int cdb_make_ext(struct cdb_make *c) {
+	char buf[12];
+	ut32 i;
+	for (i = 0; i < c->nsect; i++) {
+		ut32_pack (buf, c->sect[i].type);
+		ut32_pack (buf + 4, c->sect[i].pos);
+		ut32_pack (buf + 8, c->sect[i].len);
+		if (!buffer_putalign (&c->b, buf, 12) || !incpos (c, 12)) {
+			return 0;
+		}
+	}
+	ut32_pack (buf, c->eod);
+	ut32_pack (buf + 4, c->nsect);
+	ut32_pack (buf + 8, c->flags);
+	if (!buffer_putalign (&c->b, buf, 12) || !incpos (c, 12)) {
 		return 0;
 	}
-	c->split = (struct cdb_hp *) cdb_alloc (memsize * sizeof (struct cdb_hp));
-	if (!c->split) {
+	if (!buffer_putalign (&c->b, CDB_EXT_MAGIC, 4)) {
 		return 0;
 	}
-	c->hash = c->split + c->numentries;
+	return incpos (c, 4);
+}
 
-	for (u = i = 0; i<256; i++) {
-		u += c->count[i]; /* bounded by numentries, so no overflow */
-		c->start[i] = u;
+void cdb_make_free(struct cdb_make *c) {
+	cdb_writer_stop (c);
+	if (c->bown) {
+		cdb_alloc_free (c->bufx);
+	}
+	c->bufx = NULL;
+	c->bufsize = 0;
+	c->bown = false;
+	cdb_make_bufreset (c);
+	free (c->crcs);
+	c->crcs = NULL;
+	c->ncrc = c->mcrc = 0;
+	cdb_zwriter_free (c->z);
+	c->z = NULL;
+	cdb_kwriter_free (c->k);
+	c->k = NULL;
+	cdb_make_freelist (c);
+	free (c->runs);
+	c->runs = NULL;
+	c->nruns = 0;
+	if (c->split) {
+		cdb_alloc_free (c->split);
+		c->split = NULL;
 	}
+}
 
-	for (x = c->head; x; x=x->next) {
-		i = x->num;
-		while (i--) {
-			c->split[--c->start[255 & x->hp[i].h]] = x->hp[i];
+/* per table offsets are known up front, so the 256 tables are built
+ * independently and written in place with pwrite */
+typedef struct {
+	struct cdb_make *c;
+	ut32 off[256];
+	int n;
+	bool spilled;
+	int failed; // see sdb_th_load
+} CdbFinish;
+
+/* linear probing into hash, then packed into out */
+static void cdb_make_table(const struct cdb_hp *hp, ut32 count, struct cdb_hp *hash, char *out) {
+	ut32 u, where, len = count << 1;
+	memset (hash, 0, len * sizeof (struct cdb_hp));
+	for (u = 0; u < count; u++) {
+		where = (hp->h >> 8) % len;
+		while (hash[where].p) {
+			if (++where == len) {
+				where = 0;
+			}
 		}
+		hash[where] = *hp++;
+	}
+	for (u = 0; u < len; u++) {
+		ut32_pack (out + u * 8, hash[u].h);
+		ut32_pack (out + u * 8 + 4, hash[u].p);
 	}
+}
 
-	for (i = 0; i < 256; i++) {
-		count = c->count[i];
-		len = count << 1;
-		ut32_pack (c->final + 4 * i, c->pos);
-		for (u = 0; u<len; u++) {
-			c->hash[u].h = c->hash[u].p = 0;
+static void cdb_make_worker(void *user, int idx) {
+	CdbFinish *f = user;
+	struct cdb_make *c = f->c;
+	struct cdb_hp *hash = (struct cdb_hp *) cdb_alloc (c->memsize * sizeof (struct cdb_hp));
+	char *out = cdb_alloc (c->memsize * 8);
+	const struct cdb_hp *hp;
+	int i;
+	if (!hash || !out) {
+		sdb_th_store (f->failed, 1);
+	}
+	for (i = idx; i < 256 && !sdb_th_load (f->failed); i += f->n) {
+		ut32 count = c->count[i];
+		if (!count) {
+			continue;
 		}
 		hp = c->split + c->start[i];
-		for (u = 0; u < count; u++) {
-			where = (hp->h >> 8) % len;
-			while (c->hash[where].p) {
-				if (++where == len) {
-					where = 0;
-				}
+		if (f->spilled) {
+			if (!cdb_make_readtable (c, i, c->split)) {
+				sdb_th_store (f->failed, 1);
+				break;
 			}
-			c->hash[where] = *hp++;
+			hp = c->split;
 		}
-		for (u = 0; u < len; u++) {
-			ut32_pack (buf, c->hash[u].h);
-			ut32_pack (buf + 4, c->hash[u].p);
-			if (!buffer_putalign (&c->b, buf, 8)) {
-				return 0;
-			}
-			if (!incpos (c, 8)) {
-				return 0;
+		cdb_make_table (hp, count, hash, out);
+		if (!pwriteall (c->fd, out, count * 16, f->off[i])) {
+			sdb_th_store (f->failed, 1);
+		}
+	}
+	if (hash) {
+		cdb_alloc_free (hash);
+	}
+	if (out) {
+		cdb_alloc_free (out);
+	}
+}
+
+/* crc32c of the file, taken with the 4 bytes at sumpos zeroed, goes there */
+static int cdb_make_sum(int fd, ut32 size, ut32 sumpos) {
+	char buf[4] = {0};
+	char *map = cdb_make_map (fd, size);
+	ut32 crc;
+	if (!map) {
+		return 0;
+	}
+	crc = sdb_crc32c (0, map, sumpos);
+	crc = sdb_crc32c (crc, buf, 4);
+	crc = sdb_crc32c (crc, map + sumpos + 4, size - sumpos - 4);
+	cdb_make_unmap (fd, map, size);
+	ut32_pack (buf, crc);
+	return pwriteall (fd, buf, 4, sumpos);
+}
+
+int cdb_make_finish(struct cdb_make *c) {
+	CdbFinish f = {0};
+	ut32 i, u, nsplit, sumpos = 0;
+	bool spilled = c->spill != -1 && c->nruns > 0;
+
+	if (spilled && !cdb_make_flushrun (c)) {
+		return 0;
+	}
+	/* spilled pairs are read back one table at a time */
+	nsplit = spilled? c->memsize / 2: c->numentries;
+	if (c->memsize > (UT32_MAX / sizeof (struct cdb_hp)) || nsplit > (UT32_MAX / sizeof (struct cdb_hp))) {
+		return 0;
+	}
+	c->split = (struct cdb_hp *) cdb_alloc ((nsplit? nsplit: 1) * sizeof (struct cdb_hp));
+	if (!c->split) {
+		return 0;
+	}
+	if (c->z && !cdb_make_zsections (c)) {
+		cdb_make_free (c);
+		return 0;
+	}
+	if (c->k && !cdb_make_ksections (c)) {
+		cdb_make_free (c);
+		return 0;
+	}
+	if (c->crc) {
+		if (!cdb_make_section (c, CDB_SECT_CRC, c->ncrc? c->crcs: "", c->ncrc * 8)) {
+			cdb_make_free (c);
+			return 0;
+		}
+		/* zeroed for now, filled in once the file is complete */
+		sumpos = c->pos;
+		if (!cdb_make_section (c, CDB_SECT_SUM, "\0\0\0\0", 4)) {
+			cdb_make_free (c);
+			return 0;
+		}
+	}
+	if (c->nsect && !cdb_make_ext (c)) {
+		cdb_make_free (c);
+		return 0;
+	}
+
+	for (u = i = 0; i < 256; i++) {
+		u += c->count[i]; /* bounded by numentries, so no overflow */
+		c->start[i] = u;
+	}
+
+	if (!spilled) {
+		struct cdb_hplist *x;
+		int j;
+		for (x = c->head; x; x = x->next) {
+			j = x->num;
+			while (j--) {
+				c->split[--c->start[255 & x->hp[j].h]] = x->hp[j];
 			}
 		}
 	}
 
+	for (i = 0; i < 256; i++) {
+		f.off[i] = c->pos;
+		ut32_pack (c->final + 4 * i, c->pos);
+		if (!incpos (c, c->count[i] * 16)) {
+			cdb_make_free (c);
+			return 0;
+		}
+	}
+	/* the last records are still being written while the tables are built */
 	if (!buffer_flush (&c->b)) {
+		cdb_make_free (c);
+		return 0;
+	}
+#if __SDB_WINDOWS__
+	// both would move the same file position
+	if (!cdb_make_flush (c)) {
+		cdb_make_free (c);
+		return 0;
+	}
+#endif
+
+	f.c = c;
+	f.n = 1;
+	f.spilled = spilled;
+#if !__SDB_WINDOWS__
+	if (!spilled && c->numentries >= CDB_PAR_MIN) {
+		f.n = R_MIN (sdb_th_ncpu (), CDB_PAR_MAX);
+	}
+#endif
+	if (!sdb_th_run (f.n, cdb_make_worker, &f)) {
+		f.failed = 1;
+	}
+	if (!cdb_make_flush (c)) {
+		f.failed = 1;
+	}
+	cdb_make_free (c);
+	if (f.failed) {
 		return 0;
 	}
 	if (!seek_set (c->fd, 0)) {
 		return 0;
 	}
-	// free childs
-	for (x = c->head; x;) {
-		n = x->next;
-		cdb_alloc_free (x);
-		x = n;
+	if (!buffer_putflush (&c->b, c->final, sizeof c->final)) {
+		return 0;
 	}
-	cdb_alloc_free (c->split);
-	return buffer_putflush (&c->b, c->final, sizeof c->final);
+	return !sumpos || cdb_make_sum (c->fd, c->pos, sumpos);
 }
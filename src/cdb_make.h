@@ -5,8 +5,15 @@
 
 #include "buffer.h"
 #include "types.h"
+#include "cdb.h"
 
 #define CDB_HPLIST 1000
+/* defaults for cdb_make_async */
+#define CDB_WRITER_BUFS 4
+#define CDB_WRITER_SIZE (1 << 20)
+/* cdb_make_dedup interns values up to CDB_DUPMAX bytes, CDB_DUPPOOL in all */
+#define CDB_DUPMAX 4096
+#define CDB_DUPPOOL (64 << 20)
 
 struct cdb_hp { ut32 h; ut32 p; } ;
 
@@ -22,19 +29,57 @@ struct cdb_make {
 	ut32 count[256];
 	ut32 start[256];
 	struct cdb_hplist *head;
-	struct cdb_hp *split; /* includes space for hash */
-	struct cdb_hp *hash;
+	struct cdb_hp *split;
 	ut32 numentries;
 	ut32 memsize;
 	buffer b;
 	ut32 pos;
 	int fd;
+	ut32 eod;
+	ut32 flags;
+	ut32 nsect;
+	struct cdb_sect sect[CDB_MAXSECT];
+	/* (hash,pos) pairs beyond hplimit go to the spill file in runs
+	 * grouped by table, runs holds 256 counts per run */
+	int spill;
+	ut32 hplimit;
+	ut32 nhp;
+	ut32 nruns;
+	ut32 *runs;
+	/* full buffers written from another thread, see cdb_make_async */
+	struct cdb_writer *w;
+	/* staging buffer used instead of bspace, see cdb_make_buffer */
+	char *bufx;
+	ut32 bufsize;
+	bool bown;
+	/* (pos, crc32c) of every record, see cdb_make_checksum */
+	bool crc;
+	char *crcs;
+	ut32 ncrc;
+	ut32 mcrc;
+	/* value blocks, see cdb_make_compress and cdb_make_dedup */
+	struct cdb_zwriter *z;
+	/* front coded keys, see cdb_make_sorted */
+	struct cdb_kwriter *k;
 };
 
 extern int cdb_make_start(struct cdb_make *,int);
 extern int cdb_make_addbegin(struct cdb_make *,unsigned int,unsigned int);
 extern int cdb_make_addend(struct cdb_make *,unsigned int,unsigned int,ut32);
 extern int cdb_make_add(struct cdb_make *,const char *,unsigned int,const char *,unsigned int);
+extern int cdb_make_section(struct cdb_make *, ut32 type, const char *, ut32);
+extern int cdb_make_spill(struct cdb_make *, int fd, ut32 limit);
+extern int cdb_make_cluster(struct cdb_make *, int fd, struct cdb_hp **moved);
+extern int cdb_make_buffer(struct cdb_make *, char *buf, ut32 size);
+extern int cdb_make_checksum(struct cdb_make *);
+extern int cdb_make_compress(struct cdb_make *, int fd, ut32 bsize);
+extern int cdb_make_dedup(struct cdb_make *, int fd, ut32 bsize);
+extern int cdb_make_sorted(struct cdb_make *, ut32 interval);
+extern int cdb_make_async(struct cdb_make *, ut32 nbufs, ut32 size);
+extern int cdb_make_flush(struct cdb_make *);
 extern int cdb_make_finish(struct cdb_make *);
+extern void cdb_make_free(struct cdb_make *);
+extern char *cdb_make_map(int fd, ut32 size);
+extern void cdb_make_unmap(int fd, char *map, ut32 size);
 
 #endif
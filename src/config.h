@@ -2,8 +2,14 @@
 #define CONFIG_H
 
 #define SDB_KEYSIZE 32
-/* only available on linux, and some distros require -lrt */
+/* only available on linux, and old glibcs require -lrt */
+#ifndef USE_MONOTONIC_CLOCK
+#if __linux__
+#define USE_MONOTONIC_CLOCK 1
+#else
 #define USE_MONOTONIC_CLOCK 0
+#endif
+#endif
 
 #if SDB_KEYSIZE == 32
 #define SDB_KT ut32
@@ -97,6 +97,30 @@ static inline int r_sys_mkdirp(char *dir) {
 	return ret;
 }
 
+static void disk_zclose(Sdb *s) {
+	if (s->zpath) {
+		if (s->zfd != -1) {
+			close (s->zfd);
+			unlink (s->zpath);
+		}
+		R_FREE (s->zpath);
+	}
+	s->zfd = -1;
+}
+
+/* blocks of files written with SDB_OPTION_DEDUP alone are all raw */
+static bool disk_lz(struct cdb *db) {
+	ut32 i, zlen, rlen;
+	for (i = 0; i < db->nzblocks; i++) {
+		ut32_unpack (db->zdir + i * 12 + 4, &zlen);
+		ut32_unpack (db->zdir + i * 12 + 8, &rlen);
+		if (zlen != rlen) {
+			return true;
+		}
+	}
+	return false;
+}
+
 SDB_API bool sdb_disk_create(Sdb* s) {
 	int nlen;
 	char *str;
@@ -127,7 +151,38 @@ SDB_API bool sdb_disk_create(Sdb* s) {
 		return false;
 	}
 	cdb_make_start (&s->m, s->fdump);
+	/* files that had checksums keep them */
+	if ((s->options & SDB_OPTION_CHECKSUM) || cdb_section (&s->db, CDB_SECT_SUM, NULL)) {
+		cdb_make_checksum (&s->m);
+	}
+	bool async = (s->options & SDB_OPTION_ASYNC)
+		&& cdb_make_async (&s->m, CDB_WRITER_BUFS, s->wsize? s->wsize: CDB_WRITER_SIZE);
+	if (!async && s->wsize) {
+		cdb_make_buffer (&s->m, NULL, s->wsize);
+	}
+	/* and so do compressed ones, blocks wait in <dir>.tmpz until the end */
+	bool lz = (s->options & SDB_OPTION_COMPRESS) || disk_lz (&s->db);
+	bool dedup = (s->options & SDB_OPTION_DEDUP) || (cdb_compressed (&s->db) && !disk_lz (&s->db));
+	if (lz || dedup) {
+		s->zpath = malloc (nlen + 6);
+		if (s->zpath) {
+			memcpy (s->zpath, str, nlen + 4);
+			memcpy (s->zpath + nlen + 4, "z", 2);
+			s->zfd = open (s->zpath, O_BINARY | O_RDWR | O_CREAT | O_TRUNC, SDB_MODE);
+		}
+		if (!s->zpath || s->zfd == -1 || (lz && !cdb_make_compress (&s->m, s->zfd, CDB_ZBLOCK))
+				|| (dedup && !cdb_make_dedup (&s->m, s->zfd, CDB_ZBLOCK))) {
+			eprintf ("sdb: Cannot compress the values of '%s'.\n", str);
+			disk_zclose (s);
+			cdb_make_free (&s->m);
+			close (s->fdump);
+			s->fdump = -1;
+			free (str);
+			return false;
+		}
+	}
 	s->ndump = str;
+	s->nttl = 0;
 	return true;
 }
 
@@ -140,10 +195,147 @@ SDB_API int sdb_disk_insert(Sdb* s, const char *key, const char *val) {
 	return cdb_make_add (c, key, strlen (key), val, strlen (val));
 }
 
+/* records are appended in order, so the ttl section comes out sorted */
+SDB_API int sdb_disk_insert_bin(Sdb* s, const char *key, const ut8 *val, ut32 len, ut64 expire) {
+	ut32 pos = s->m.pos;
+	if (!key || !val || !cdb_make_add (&s->m, key, strlen (key), (const char *)val, len)) {
+		return 0;
+	}
+	if (!expire) {
+		return 1;
+	}
+	if (s->nttl == s->mttl) {
+		ut32 m = s->mttl? s->mttl * 2: 64;
+		char *ttl = realloc (s->ttl, m * 12);
+		if (!ttl) {
+			return 0;
+		}
+		s->ttl = ttl;
+		s->mttl = m;
+	}
+	char *e = s->ttl + s->nttl++ * 12;
+	ut32_pack (e, pos);
+	ut32_pack (e + 4, (ut32)expire);
+	ut32_pack (e + 8, (ut32)(expire >> 32));
+	return 1;
+}
+
+SDB_API int sdb_disk_insert_expire(Sdb* s, const char *key, const char *val, ut64 expire) {
+	return val? sdb_disk_insert_bin (s, key, (const ut8 *)val, strlen (val), expire): 0;
+}
+
+/* expire time of the record at pos, 0 if it never expires */
+SDB_API ut64 sdb_disk_expire(Sdb* s, ut32 pos) {
+	ut32 len, lo = 0, hi, p, e0, e1;
+	char *ttl = (char *)cdb_section (&s->db, CDB_SECT_TTL, &len);
+	if (!ttl) {
+		return 0LL;
+	}
+	hi = len / 12;
+	while (lo < hi) {
+		ut32 mid = lo + (hi - lo) / 2;
+		ut32_unpack (ttl + mid * 12, &p);
+		if (p == pos) {
+			ut32_unpack (ttl + mid * 12 + 4, &e0);
+			ut32_unpack (ttl + mid * 12 + 8, &e1);
+			return ((ut64)e1 << 32) | e0;
+		}
+		if (p < pos) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return 0LL;
+}
+
+/* the record at pos has a ttl and it already passed */
+SDB_API bool sdb_disk_expired(Sdb* s, ut32 pos) {
+	ut64 expire = s->db.nsect? sdb_disk_expire (s, pos): 0LL;
+	return expire && sdb_now () > expire;
+}
+
+static int ttl_cmp(const void *a, const void *b) {
+	ut32 x, y;
+	ut32_unpack ((char *)a, &x);
+	ut32_unpack ((char *)b, &y);
+	return x < y? -1: x > y;
+}
+
+/* rewrites the dump with the records in hash table order, the positions
+ * kept for the ttl section are moved along. see SDB_OPTION_CLUSTER */
+static bool disk_cluster(Sdb *s) {
+	struct cdb_hp *moved;
+	ut32 i, n = s->m.numentries;
+	int fd, nlen;
+	char *path;
+	if (!s->ndump || n < 2) {
+		return true;
+	}
+	nlen = strlen (s->ndump);
+	path = malloc (nlen + 2);
+	if (!path) {
+		return true;
+	}
+	memcpy (path, s->ndump, nlen);
+	memcpy (path + nlen, "2", 2);
+	fd = open (path, O_BINARY | O_RDWR | O_CREAT | O_TRUNC, SDB_MODE);
+	if (fd == -1) {
+		free (path);
+		return true;
+	}
+	if (!cdb_make_cluster (&s->m, fd, &moved)) {
+		/* dumps left untouched are still fine in insertion order */
+		bool ret = s->m.fd != fd;
+		close (fd);
+		unlink (path);
+		free (path);
+		return ret;
+	}
+	close (s->fdump);
+	unlink (s->ndump);
+	free (s->ndump);
+	s->ndump = path;
+	s->fdump = fd;
+	for (i = 0; i < s->nttl; i++) {
+		char *e = s->ttl + i * 12;
+		ut32 pos, lo = 0, hi = n;
+		ut32_unpack (e, &pos);
+		while (lo < hi) {
+			ut32 mid = lo + (hi - lo) / 2;
+			if (moved[mid].h < pos) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		if (lo < n && moved[lo].h == pos) {
+			ut32_pack (e, moved[lo].p);
+		}
+	}
+	if (s->nttl > 1) {
+		qsort (s->ttl, s->nttl, 12, ttl_cmp);
+	}
+	free (moved);
+	return true;
+}
+
 #define IFRET(x) if (x) ret = 0
 SDB_API bool sdb_disk_finish (Sdb* s) {
 	bool reopen = false, ret = true;
+	if (s->options & SDB_OPTION_CLUSTER) {
+		IFRET (!disk_cluster (s));
+	}
+	/* keep the index of files that already had one */
+	if ((s->options & SDB_OPTION_INDEX) || cdb_section (&s->db, CDB_SECT_INDEX, NULL)) {
+		IFRET (!sdb_index_write (s));
+	}
+	if (s->nttl) {
+		IFRET (!cdb_make_section (&s->m, CDB_SECT_TTL, s->ttl, s->nttl * 12));
+		s->nttl = 0;
+	}
 	IFRET (!cdb_make_finish (&s->m));
+	disk_zclose (s);
 #if USE_MMAN
 	IFRET (fsync (s->fdump));
 #endif
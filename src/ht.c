@@ -23,10 +23,6 @@ static inline ut32 hashfn(SdbHt *ht, const void *k) {
 	return ht->hashfn ? ht->hashfn (k) : (ut32)(size_t)(k);
 }
 
-static inline ut32 bucketfn(SdbHt *ht, const void *k) {
-	return hashfn (ht, k) % ht->size;
-}
-
 static inline char *dupkey(SdbHt *ht, const void *k) {
 	return ht->dupkey ? ht->dupkey (k) : (char *)k;
 }
@@ -165,12 +161,10 @@ SDB_API void ht_free(SdbHt* ht) {
 	free (ht);
 }
 
-// Increases the size of the hashtable by 2.
-static void internal_ht_grow(SdbHt* ht) {
+// Rehashes all the entries into a table of size sz.
+static void internal_ht_resize(SdbHt* ht, ut32 idx, ut32 sz) {
 	SdbHt* ht2;
 	SdbHt swap;
-	ut32 idx = ht->prime_idx != UT32_MAX ? ht->prime_idx + 1 : UT32_MAX;
-	ut32 sz = compute_size (idx, ht->size * 2);
 	ut32 i;
 
 	ht2 = internal_ht_new (sz, idx, ht->hashfn, ht->cmp, ht->dupkey, ht->dupvalue,
@@ -194,15 +188,40 @@ static void internal_ht_grow(SdbHt* ht) {
 	ht_free (ht2);
 }
 
+// Increases the size of the hashtable by 2.
+static void internal_ht_grow(SdbHt* ht) {
+	ut32 idx = ht->prime_idx != UT32_MAX ? ht->prime_idx + 1 : UT32_MAX;
+	internal_ht_resize (ht, idx, compute_size (idx, ht->size * 2));
+}
+
+// Makes room for count elements at once, so inserting them does not
+// rehash the table on every growth step.
+SDB_API void ht_reserve(SdbHt* ht, ut32 count) {
+	ut32 idx = ht->prime_idx;
+	ut32 sz = ht->size;
+
+	if (count < LOAD_FACTOR * sz) {
+		return;
+	}
+	while (count >= LOAD_FACTOR * sz) {
+		if (idx != UT32_MAX && idx + 1 < S_ARRAY_SIZE (ht_primes_sizes)) {
+			idx++;
+		} else {
+			idx = UT32_MAX;
+		}
+		sz = compute_size (idx, sz * 2);
+	}
+	internal_ht_resize (ht, idx, sz);
+}
+
 static void check_growing(SdbHt *ht) {
 	if (ht->count >= LOAD_FACTOR * ht->size) {
 		internal_ht_grow (ht);
 	}
 }
 
-static HtKv *reserve_kv(SdbHt *ht, const char *key, const int key_len, bool update) {
-	ut32 bucket = bucketfn (ht, key);
-	HtBucket *bt = &ht->table[bucket];
+static HtKv *reserve_kv(SdbHt *ht, const char *key, const int key_len, ut32 hash, bool update) {
+	HtBucket *bt = &ht->table[hash % ht->size];
 	HtKv *kvtmp;
 	ut32 j;
 
@@ -227,8 +246,9 @@ static HtKv *reserve_kv(SdbHt *ht, const char *key, const int key_len, bool upda
 	return kv_at (ht, bt, bt->count - 1);
 }
 
-bool ht_insert_kv(SdbHt *ht, HtKv *kv, bool update) {
-	HtKv *kv_dst = reserve_kv (ht, kv->key, kv->key_len, update);
+// Same as ht_insert_kv, but with the hash of kv->key already computed.
+bool ht_insert_kv_hash(SdbHt *ht, HtKv *kv, ut32 hash, bool update) {
+	HtKv *kv_dst = reserve_kv (ht, kv->key, kv->key_len, hash, update);
 	if (!kv_dst) {
 		return false;
 	}
@@ -238,13 +258,18 @@ bool ht_insert_kv(SdbHt *ht, HtKv *kv, bool update) {
 	return true;
 }
 
+bool ht_insert_kv(SdbHt *ht, HtKv *kv, bool update) {
+	return ht_insert_kv_hash (ht, kv, hashfn (ht, kv->key), update);
+}
+
 static bool insert_update(SdbHt *ht, const char *key, void *value, bool update) {
 	ut32 key_len = calcsize_key (ht, key);
-	HtKv* kv_dst = reserve_kv (ht, key, key_len, update);
+	HtKv* kv_dst = reserve_kv (ht, key, key_len, hashfn (ht, key), update);
 	if (!kv_dst) {
 		return false;
 	}
-
+	/* entries larger than HtKv get their extra fields cleared */
+	memset (kv_dst, 0, ht->elem_size);
 	kv_dst->key = dupkey (ht, key);
 	kv_dst->key_len = key_len;
 	kv_dst->value = dupval (ht, value);
@@ -269,14 +294,17 @@ SDB_API bool ht_update(SdbHt* ht, const char* key, void* value) {
 // If `found` is not NULL, it will be set to true if the entry was found, false
 // otherwise.
 SDB_API HtKv* ht_find_kv(SdbHt* ht, const char* key, bool* found) {
-	ut32 bucket = bucketfn (ht, key);
+	return ht_find_kv_hash (ht, key, calcsize_key (ht, key), hashfn (ht, key), found);
+}
 
+// Same as ht_find_kv, for callers that already know the key length and
+// the value ht->hashfn returns for it.
+SDB_API HtKv* ht_find_kv_hash(SdbHt* ht, const char* key, ut32 key_len, ut32 hash, bool* found) {
 	if (found) {
 		*found = false;
 	}
 
-	HtBucket *bt = &ht->table[bucket];
-	ut32 key_len = calcsize_key (ht, key);
+	HtBucket *bt = &ht->table[hash % ht->size];
 	HtKv *kv;
 	ut32 j;
 
@@ -301,9 +329,11 @@ SDB_API void* ht_find(SdbHt* ht, const char* key, bool* found) {
 
 // Deletes a entry from the hash table from the key, if the pair exists.
 SDB_API bool ht_delete(SdbHt* ht, const char* key) {
-	ut32 bucket = bucketfn (ht, key);
-	HtBucket *bt = &ht->table[bucket];
-	ut32 key_len = calcsize_key (ht, key);
+	return ht_delete_hash (ht, key, calcsize_key (ht, key), hashfn (ht, key));
+}
+
+SDB_API bool ht_delete_hash(SdbHt* ht, const char* key, ut32 key_len, ut32 hash) {
+	HtBucket *bt = &ht->table[hash % ht->size];
 	HtKv *kv;
 	ut32 j;
 
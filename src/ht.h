@@ -59,8 +59,13 @@ SDB_API bool ht_delete(SdbHt* ht, const char* key);
 // Find the value corresponding to the matching key.
 SDB_API void* ht_find(SdbHt* ht, const char* key, bool* found);
 SDB_API void ht_foreach(SdbHt *ht, HtForeachCallback cb, void *user);
+SDB_API void ht_reserve(SdbHt* ht, ut32 count);
 
 HtKv* ht_find_kv(SdbHt* ht, const char* key, bool* found);
 bool ht_insert_kv(SdbHt *ht, HtKv *kv, bool update);
+// Variants for keys whose length and ht->hashfn value are already known.
+SDB_API HtKv* ht_find_kv_hash(SdbHt* ht, const char* key, ut32 key_len, ut32 hash, bool* found);
+SDB_API bool ht_delete_hash(SdbHt* ht, const char* key, ut32 key_len, ut32 hash);
+bool ht_insert_kv_hash(SdbHt *ht, HtKv *kv, ut32 hash, bool update);
 
 #endif // __HT_H
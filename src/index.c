@@ -0,0 +1,286 @@
+/* sdb - MIT - Copyright 2018 - pancake */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdb.h"
+
+typedef struct {
+	const char *key;
+	ut32 pos;
+} SdbIndexKey;
+
+static int index_key_cmp(const void *a, const void *b) {
+	return strcmp (((const SdbIndexKey *)a)->key, ((const SdbIndexKey *)b)->key);
+}
+
+static int index_kv_cmp(const void *a, const void *b) {
+	return strcmp (sdbkv_key (*(SdbKv * const *)a), sdbkv_key (*(SdbKv * const *)b));
+}
+
+/* sort the records added so far by key and store their offsets in a
+ * section. called by sdb_disk_finish() before writing the hash tables */
+SDB_API bool sdb_index_write(Sdb *s) {
+	struct cdb_make *c = &s->m;
+	struct cdb_hplist *x;
+	SdbIndexKey *keys;
+	ut32 i, n = 0, size = c->pos;
+	char *map, *buf;
+	bool ret = false;
+	if (!cdb_make_flush (c)) {
+		return false;
+	}
+	if (!c->numentries) {
+		return cdb_make_section (c, CDB_SECT_INDEX, "", 0);
+	}
+	if (!(map = cdb_make_map (c->fd, size))) {
+		return false;
+	}
+	keys = calloc (c->numentries, sizeof (SdbIndexKey));
+	buf = malloc (c->numentries * 4);
+	if (!keys || !buf) {
+		goto beach;
+	}
+	for (x = c->head; x; x = x->next) {
+		for (i = 0; i < (ut32)x->num && n < c->numentries; i++) {
+			keys[n].key = map + x->hp[i].p + KVLSZ;
+			keys[n].pos = x->hp[i].p;
+			n++;
+		}
+	}
+	qsort (keys, n, sizeof (SdbIndexKey), index_key_cmp);
+	for (i = 0; i < n; i++) {
+		ut32_pack (buf + i * 4, keys[i].pos);
+	}
+	/* unmapping moves the writer back to the end of the records, so it
+	 * has to happen before the section is appended */
+	cdb_make_unmap (c->fd, map, size);
+	map = NULL;
+	ret = cdb_make_section (c, CDB_SECT_INDEX, buf, n * 4);
+beach:
+	if (map) {
+		cdb_make_unmap (c->fd, map, size);
+	}
+	free (keys);
+	free (buf);
+	return ret;
+}
+
+SDB_API bool sdb_index_has(Sdb *s) {
+	return s->fd == -1 || !cdb_loaded (&s->db) || cdb_sorted (&s->db)
+		|| cdb_section (&s->db, CDB_SECT_INDEX, NULL);
+}
+
+/* memory keys in order, including the deleted ones that shadow the disk */
+static bool index_mem(Sdb *s) {
+	ut32 i, j, n = 0;
+	if (!s->reorder) {
+		return true;
+	}
+	SdbKv **order = realloc (s->order, (s->ht->count + 1) * sizeof (SdbKv *));
+	if (!order) {
+		return false;
+	}
+	for (i = 0; i < s->ht->size; i++) {
+		HtBucket *bt = &s->ht->table[i];
+		for (j = 0; j < bt->count && n < s->ht->count; j++) {
+			order[n++] = (SdbKv *)((char *)bt->arr + j * s->ht->elem_size);
+		}
+	}
+	qsort (order, n, sizeof (SdbKv *), index_kv_cmp);
+	s->order = order;
+	s->norder = n;
+	s->reorder = false;
+	return true;
+}
+
+static ut32 mem_lower(Sdb *s, const char *key) {
+	ut32 lo = 0, hi = s->norder;
+	while (lo < hi) {
+		ut32 mid = lo + (hi - lo) / 2;
+		if (strcmp (sdbkv_key (s->order[mid]), key) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/* c only holds the record buffer of unmapped files. sorted files have no
+ * idx, their records are already in order and c walks them one by one */
+static bool disk_at(Sdb *s, SdbCursor *c, char *idx, ut32 i, const char **k, const char **v) {
+	if (idx) {
+		ut32_unpack (idx + i * 4, &c->pos);
+		c->end = s->db.eod;
+	}
+	return sdb_cursor_next (s, c, k, v, NULL);
+}
+
+/* like disk_at, records whose ttl passed are skipped as well */
+static bool disk_live(Sdb *s, SdbCursor *c, char *idx, ut32 i, const char **k, const char **v) {
+	ut32 pos = c->pos;
+	if (idx) {
+		ut32_unpack (idx + i * 4, &pos);
+	}
+	return disk_at (s, c, idx, i, k, v) && !sdb_disk_expired (s, pos);
+}
+
+static ut32 disk_lower(Sdb *s, SdbCursor *c, char *idx, ut32 n, const char *key) {
+	const char *k;
+	ut32 lo = 0, hi = n;
+	if (!idx) {
+		ut32 rec, i = cdb_klower (&s->db, &c->kc, key, strlen (key), &rec);
+		if (i < n) {
+			c->pos = rec;
+		}
+		return i;
+	}
+	while (lo < hi) {
+		ut32 mid = lo + (hi - lo) / 2;
+		if (!disk_at (s, c, idx, mid, &k, NULL) || strcmp (k, key) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+static bool range_walk(Sdb *s, char *idx, ut32 n, const char *from, const char *to, SdbForeachCallback cb, void *user) {
+	const char *dk, *dv, *mk, *hk = NULL, *hv = NULL;
+	ut32 di = 0, mi = 0, held = UT32_MAX;
+	bool ret = true;
+	SdbCursor c;
+	int cmp;
+	sdb_cursor_begin (s, &c);
+	if (from) {
+		di = n? disk_lower (s, &c, idx, n, from): 0;
+		mi = mem_lower (s, from);
+	}
+	for (;;) {
+		mk = NULL;
+		/* each record is read once, sorted files walk the cursor */
+		if (held != di) {
+			while (di < n && !disk_live (s, &c, idx, di, &hk, &hv)) {
+				di++;
+			}
+			held = di;
+		}
+		dk = hk;
+		dv = hv;
+		if (di >= n || (to && strcmp (dk, to) >= 0)) {
+			dk = NULL;
+		}
+		if (mi < s->norder) {
+			mk = sdbkv_key (s->order[mi]);
+			if (to && strcmp (mk, to) >= 0) {
+				mk = NULL;
+			}
+		}
+		if (!dk && !mk) {
+			break;
+		}
+		cmp = !dk? 1: !mk? -1: strcmp (dk, mk);
+		if (cmp < 0) {
+			di++;
+			if (!cb (user, dk, dv)) {
+				ret = false;
+				break;
+			}
+			continue;
+		}
+		if (!cmp) {
+			di++; // shadowed by the memory entry
+		}
+		SdbKv *kv = s->order[mi++];
+		if (sdbkv_value_len (kv) > 0) {
+			if (!cb (user, sdbkv_key (kv), sdbkv_value (kv))) {
+				ret = false;
+				break;
+			}
+		}
+	}
+	sdb_cursor_end (s, &c);
+	return ret;
+}
+
+/* visit the keys in [from, to) in order, merging the sorted disk index with
+ * the memory table. NULL bounds are open. needs sdb_index_has() */
+SDB_API bool sdb_index_range(Sdb *s, const char *from, const char *to, SdbForeachCallback cb, void *user) {
+	ut32 len = 0;
+	char *idx = NULL;
+	if (!s || !cb || !index_mem (s)) {
+		return false;
+	}
+	if (s->fd != -1 && cdb_loaded (&s->db)) {
+		if (cdb_sorted (&s->db)) {
+			return range_walk (s, NULL, s->db.nkeys, from, to, cb, user);
+		}
+		idx = (char *)cdb_section (&s->db, CDB_SECT_INDEX, &len);
+		if (!idx) {
+			return false;
+		}
+	}
+	return range_walk (s, idx, len / 4, from, to, cb, user);
+}
+
+/* sort the offsets of a file written without index, 4 bytes per record */
+static char *index_scan(Sdb *s, ut32 *count) {
+	SdbIndexKey *keys;
+	const char *k;
+	SdbCursor c;
+	ut32 i, pos, n = 0;
+	char *buf;
+	bool copy = !s->db.map;
+	sdb_cursor_begin (s, &c);
+	while (sdb_cursor_next (s, &c, NULL, NULL, NULL)) {
+		n++;
+	}
+	keys = calloc (n + 1, sizeof (SdbIndexKey));
+	buf = malloc (n * 4 + 1);
+	if (!keys || !buf) {
+		free (keys);
+		free (buf);
+		return NULL;
+	}
+	sdb_cursor_begin (s, &c);
+	for (i = 0, pos = c.pos; i < n && sdb_cursor_next (s, &c, &k, NULL, NULL); i++) {
+		/* unmapped keys only live until the next record */
+		keys[i].key = copy? strdup (k): k;
+		keys[i].pos = pos;
+		pos = c.pos;
+		if (!keys[i].key) {
+			break;
+		}
+	}
+	sdb_cursor_end (s, &c);
+	qsort (keys, i, sizeof (SdbIndexKey), index_key_cmp);
+	for (n = 0; n < i; n++) {
+		ut32_pack (buf + n * 4, keys[n].pos);
+		if (copy) {
+			free ((char *)keys[n].key);
+		}
+	}
+	free (keys);
+	*count = i;
+	return buf;
+}
+
+SDB_API bool sdb_range(Sdb *s, const char *from, const char *to, SdbForeachCallback cb, void *user) {
+	ut32 n = 0;
+	bool ret;
+	char *idx;
+	if (!s || !cb) {
+		return false;
+	}
+	if (sdb_index_has (s)) {
+		return sdb_index_range (s, from, to, cb, user);
+	}
+	if (!index_mem (s) || !(idx = index_scan (s, &n))) {
+		return false;
+	}
+	ret = range_walk (s, idx, n, from, to, cb, user);
+	free (idx);
+	return ret;
+}
@@ -69,7 +69,16 @@ SDB_API int sdb_journal_load(Sdb *s) {
 		eq = strchr (cur, '=');
 		if (eq) {
 			*eq++ = 0;
-			sdb_set (s, cur, eq, 0);
+			if (*eq == SDB_JOURNAL_BIN) {
+				int len = 0;
+				ut8 *bin = sdb_decode (eq + 1, &len);
+				if (bin) {
+					sdb_set_bin (s, cur, bin, len, 0);
+					free (bin);
+				}
+			} else {
+				sdb_set (s, cur, eq, 0);
+			}
 			changes ++;
 		}
 		cur = ptr + 1;
@@ -78,19 +87,109 @@ SDB_API int sdb_journal_load(Sdb *s) {
 	return changes;
 }
 
+/* key=value\n in one write, marker goes before the value if not zero */
+static bool journal_line(Sdb *s, const char *key, char marker, const char *val, size_t vlen) {
+	size_t kl = strlen (key), len = 0;
+	char *buf = malloc (kl + vlen + 3);
+	bool ret;
+	if (!buf) {
+		return false;
+	}
+	memcpy (buf, key, kl);
+	len += kl;
+	buf[len++] = '=';
+	if (marker) {
+		buf[len++] = marker;
+	}
+	memcpy (buf + len, val, vlen);
+	len += vlen;
+	buf[len++] = '\n';
+	ret = write (s->journal, buf, len) == (ssize_t)len;
+	free (buf);
+#if USE_MMAN
+	(void)fsync (s->journal);
+#endif
+	return ret;
+}
+
 SDB_API bool sdb_journal_log(Sdb *s, const char *key, const char *val) {
-	if (s->journal == -1) {
+	if (s->journal == -1 || !key || !val) {
 		return false;
 	}
-	const char *str = sdb_fmt ("%s=%s\n", key, val);
-	int len = strlen (str);
-	if (write (s->journal, str, len) != len) {
+	return journal_line (s, key, 0, val, strlen (val));
+}
+
+/* values that would break the line format are stored base64 encoded */
+SDB_API bool sdb_journal_log_bin(Sdb *s, const char *key, const ut8 *val, ut32 len) {
+	char *enc;
+	bool ret;
+	if (s->journal == -1 || !key || (!val && len)) {
 		return false;
 	}
+	if (!len || (*val != SDB_JOURNAL_BIN && !memchr (val, '\n', len) && !memchr (val, 0, len))) {
+		return journal_line (s, key, 0, len? (const char *)val: "", len);
+	}
+	enc = sdb_encode (val, len);
+	if (!enc) {
+		return false;
+	}
+	ret = journal_line (s, key, SDB_JOURNAL_BIN, enc, strlen (enc));
+	free (enc);
+	return ret;
+}
+
+/* all the lines in one write, and a single fsync */
+SDB_API bool sdb_journal_log_batch(Sdb *s, const SdbKvPair *pairs, size_t n) {
+	size_t i, len = 0, size = 0;
+	char *buf = NULL;
+	bool ret;
+	if (s->journal == -1) {
+		return false;
+	}
+	for (i = 0; i < n; i++) {
+		const char *k = pairs[i].key;
+		const char *v = pairs[i].value? pairs[i].value: "";
+		char *enc = NULL;
+		size_t kl, vl;
+		if (!k) {
+			continue;
+		}
+		if (*v == SDB_JOURNAL_BIN || strchr (v, '\n')) {
+			enc = sdb_encode ((const ut8 *)v, strlen (v));
+			if (!enc) {
+				continue;
+			}
+		}
+		kl = strlen (k);
+		vl = strlen (enc? enc: v);
+		if (len + kl + vl + 3 > size) {
+			char *b;
+			size = (len + kl + vl + 3) * 2;
+			b = realloc (buf, size);
+			if (!b) {
+				free (enc);
+				free (buf);
+				return false;
+			}
+			buf = b;
+		}
+		memcpy (buf + len, k, kl);
+		len += kl;
+		buf[len++] = '=';
+		if (enc) {
+			buf[len++] = SDB_JOURNAL_BIN;
+		}
+		memcpy (buf + len, enc? enc: v, vl);
+		len += vl;
+		buf[len++] = '\n';
+		free (enc);
+	}
+	ret = !len || write (s->journal, buf, len) == (ssize_t)len;
+	free (buf);
 #if USE_MMAN
 	(void)fsync (s->journal);
 #endif
-	return true;
+	return ret;
 }
 
 SDB_API bool sdb_journal_clear(Sdb *s) {
@@ -0,0 +1,151 @@
+/* sdb - MIT - Copyright 2018 - pancake */
+
+#include "sdb.h"
+
+/* lz77 for the value blocks, lz4 style: every sequence is a token with
+ * both lengths, the literals, a 2 byte distance and the rest of the match
+ * length. the last sequence only has literals */
+
+#define LZ_HASH_BITS 12
+#define LZ_MINMATCH 4
+#define LZ_MAXDIST 65535
+
+static inline ut32 lz_read32(const ut8 *p) {
+	ut32 v;
+	memcpy (&v, p, 4);
+	return v;
+}
+
+static inline ut32 lz_hash(ut32 v) {
+	return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static ut8 *lz_putlen(ut8 *op, const ut8 *oend, ut32 len) {
+	for (; len >= 255; len -= 255) {
+		if (op >= oend) {
+			return NULL;
+		}
+		*op++ = 255;
+	}
+	if (op >= oend) {
+		return NULL;
+	}
+	*op++ = (ut8)len;
+	return op;
+}
+
+static ut8 *lz_sequence(ut8 *op, const ut8 *oend, const ut8 *lit, ut32 nlit, ut32 dist, ut32 mlen) {
+	ut32 ml = mlen? mlen - LZ_MINMATCH: 0;
+	ut8 *token = op++;
+	if (token >= oend) {
+		return NULL;
+	}
+	*token = (ut8)((R_MIN (nlit, 15) << 4) | R_MIN (ml, 15));
+	if (nlit >= 15 && !(op = lz_putlen (op, oend, nlit - 15))) {
+		return NULL;
+	}
+	if ((ut32)(oend - op) < nlit) {
+		return NULL;
+	}
+	memcpy (op, lit, nlit);
+	op += nlit;
+	if (!mlen) {
+		return op;
+	}
+	if (oend - op < 2) {
+		return NULL;
+	}
+	*op++ = dist & 0xff;
+	*op++ = dist >> 8;
+	if (ml >= 15 && !(op = lz_putlen (op, oend, ml - 15))) {
+		return NULL;
+	}
+	return op;
+}
+
+/* returns the compressed size, 0 if it does not fit in cap */
+SDB_API ut32 sdb_lz_compress(const ut8 *src, ut32 len, ut8 *dst, ut32 cap) {
+	ut32 table[1 << LZ_HASH_BITS] = {0}; // positions plus one
+	const ut8 *ip = src, *anchor = src, *end = src + len;
+	const ut8 *oend = dst + cap;
+	ut8 *op = dst;
+	while (len >= LZ_MINMATCH && ip + LZ_MINMATCH <= end) {
+		ut32 h = lz_hash (lz_read32 (ip));
+		ut32 ref = table[h];
+		const ut8 *m = src + ref - 1;
+		ut32 mlen = LZ_MINMATCH;
+		table[h] = (ut32)(ip - src) + 1;
+		if (!ref || ip - m > LZ_MAXDIST || lz_read32 (m) != lz_read32 (ip)) {
+			ip++;
+			continue;
+		}
+		while (ip + mlen < end && ip[mlen] == m[mlen]) {
+			mlen++;
+		}
+		op = lz_sequence (op, oend, anchor, ip - anchor, ip - m, mlen);
+		if (!op) {
+			return 0;
+		}
+		ip += mlen;
+		anchor = ip;
+	}
+	op = lz_sequence (op, oend, anchor, end - anchor, 0, 0);
+	return op? (ut32)(op - dst): 0;
+}
+
+static bool lz_getlen(const ut8 **ip, const ut8 *iend, ut32 *n) {
+	ut8 b;
+	do {
+		if (*ip >= iend || *n > UT32_MAX - 255) {
+			return false;
+		}
+		b = *(*ip)++;
+		*n += b;
+	} while (b == 255);
+	return true;
+}
+
+/* every length and distance is checked, broken input only fails */
+SDB_API bool sdb_lz_decompress(const ut8 *src, ut32 len, ut8 *dst, ut32 cap, ut32 *out) {
+	const ut8 *ip = src, *iend = src + len;
+	ut8 *op = dst, *oend = dst + cap;
+	while (ip < iend) {
+		ut32 token = *ip++, n = token >> 4, dist;
+		if (n == 15 && !lz_getlen (&ip, iend, &n)) {
+			return false;
+		}
+		if ((ut32)(iend - ip) < n || (ut32)(oend - op) < n) {
+			return false;
+		}
+		memcpy (op, ip, n);
+		ip += n;
+		op += n;
+		if (ip == iend) {
+			break;
+		}
+		if (iend - ip < 2) {
+			return false;
+		}
+		dist = ip[0] | (ip[1] << 8);
+		ip += 2;
+		n = token & 15;
+		if (n == 15 && !lz_getlen (&ip, iend, &n)) {
+			return false;
+		}
+		n += LZ_MINMATCH;
+		if (!dist || dist > (ut32)(op - dst) || (ut32)(oend - op) < n) {
+			return false;
+		}
+		if (dist >= n) {
+			memcpy (op, op - dist, n);
+			op += n;
+		} else {
+			const ut8 *m = op - dist;
+			while (n--) {
+				*op++ = *m++;
+			}
+		}
+	}
+	*out = (ut32)(op - dst);
+	return true;
+}
@@ -168,23 +168,24 @@ static void synchronize(int sig UNUSED) {
 #endif
 static int sdb_grep_dump(const char *db, int fmt, bool grep,
                          const char *expgrep) {
-	char *v;
-	char k[SDB_MAX_KEY] = {
-		0
-	};
+	const char *k, *v;
 	const char *comma = "";
+	SdbCursor c;
+	ut32 pos;
 	Sdb *s = sdb_new (NULL, db, 0);
 	if (!s) {
 		return 1;
 	}
 	sdb_config (s, options);
-	sdb_dump_begin (s);
+	sdb_cursor_begin (s, &c);
 	if (fmt == MODE_JSON) {
 		printf ("{");
 	}
-	while (sdb_dump_dupnext (s, k, &v, NULL)) {
+	for (pos = c.pos; sdb_cursor_next (s, &c, &k, &v, NULL); pos = c.pos) {
+		if (sdb_disk_expired (s, pos)) {
+			continue;
+		}
 		if (grep && !strstr (k, expgrep) && !strstr (v, expgrep)) {
-			free (v);
 			continue;
 		}
 		switch (fmt) {
@@ -208,8 +209,8 @@ static int sdb_grep_dump(const char *db, int fmt, bool grep,
 			printf ("%s=%s\n", k, v);
 			break;
 		}
-		free (v);
 	}
+	sdb_cursor_end (s, &c);
 	switch (fmt) {
 	case MODE_ZERO:
 		fflush (stdout);
@@ -277,18 +278,23 @@ static int createdb(const char *f, const char **args, int nargs) {
 }
 
 static int showusage(int o) {
-	printf ("usage: sdb [-0cdehjJv|-D A B] [-|db] "
+	printf ("usage: sdb [-0cCdehijJuvVz|-D A B] [-|db] "
 		"[.file]|[-=]|[-+][(idx)key[:json|=value] ..]\n");
 	if (o == 2) {
 		printf ("  -0      terminate results with \\x00\n"
 			"  -c      count the number of keys database\n"
+			"  -C      keep checksums of the records and the file\n"
 			"  -d      decode base64 from stdin\n"
 			"  -D      diff two databases\n"
 			"  -e      encode stdin as base64\n"
 			"  -h      show this help\n"
+			"  -i      keep a sorted key index in the database\n"
 			"  -j      output in json\n"
 			"  -J      enable journaling\n"
-			"  -v      show version information\n");
+			"  -u      store repeated values once\n"
+			"  -v      show version information\n"
+			"  -V      verify the file and its checksums (--verify)\n"
+			"  -z      compress the values of the database\n");
 		return 0;
 	}
 	return o;
@@ -356,24 +362,22 @@ static int base64decode() {
 
 static int dbdiff(const char *a, const char *b) {
 	int n = 0;
-	char *v;
-	char k[SDB_MAX_KEY] = {
-		0
-	};
-	const char *v2;
+	const char *k, *v, *v2;
+	SdbCursor c;
 	Sdb *A = sdb_new (NULL, a, 0);
 	Sdb *B = sdb_new (NULL, b, 0);
-	sdb_dump_begin (A);
-	while (sdb_dump_dupnext (A, k, &v, NULL)) {
+	sdb_cursor_begin (A, &c);
+	while (sdb_cursor_next (A, &c, &k, &v, NULL)) {
 		v2 = sdb_const_get (B, k, 0);
 		if (!v2) {
 			printf ("%s=\n", k);
 			n = 1;
 		}
 	}
-	sdb_dump_begin (B);
-	while (sdb_dump_dupnext (B, k, &v, NULL)) {
-		if (!v || !*v) {
+	sdb_cursor_end (A, &c);
+	sdb_cursor_begin (B, &c);
+	while (sdb_cursor_next (B, &c, &k, &v, NULL)) {
+		if (!*v) {
 			continue;
 		}
 		v2 = sdb_const_get (A, k, 0);
@@ -382,9 +386,9 @@ static int dbdiff(const char *a, const char *b) {
 			n = 1;
 		}
 	}
+	sdb_cursor_end (B, &c);
 	sdb_free (A);
 	sdb_free (B);
-	free (v);
 	return n;
 }
 
@@ -399,6 +403,34 @@ int showcount(const char *db) {
 	return 0;
 }
 
+static int verify(const char *db) {
+	SdbVerify v;
+	bool ok;
+	s = sdb_new (NULL, db, 0);
+	if (!s) {
+		return 1;
+	}
+	ok = sdb_verify (s, &v, 0);
+	printf ("records %u\n", v.records);
+	if (v.badrec) {
+		printf ("bad records %u%s\n", v.badrec, v.hascrc? "": " (no checksums)");
+	}
+	if (v.badslot) {
+		printf ("bad slots %u\n", v.badslot);
+	}
+	if (v.badtable) {
+		printf ("bad tables %u\n", v.badtable);
+	}
+	if (v.badblock) {
+		printf ("bad value blocks %u\n", v.badblock);
+	}
+	if (v.hassum) {
+		printf ("checksum %s\n", v.badsum? "bad": "ok");
+	}
+	sdb_free (s);
+	return ok? 0: 1;
+}
+
 int main(int argc, const char **argv) {
 	char *line;
 	const char *arg, *grep = NULL;
@@ -433,6 +465,45 @@ int main(int argc, const char **argv) {
 			grep = argv[2];
 			argi += 2;
 			break;
+		case 'i':
+			options |= SDB_OPTION_INDEX;
+			db0++;
+			argi++;
+			if (db0 >= argc) {
+				return showusage (1);
+			}
+			break;
+		case 'C':
+			options |= SDB_OPTION_CHECKSUM;
+			db0++;
+			argi++;
+			if (db0 >= argc) {
+				return showusage (1);
+			}
+			break;
+		case 'z':
+			options |= SDB_OPTION_COMPRESS;
+			db0++;
+			argi++;
+			if (db0 >= argc) {
+				return showusage (1);
+			}
+			break;
+		case 'u':
+			options |= SDB_OPTION_DEDUP;
+			db0++;
+			argi++;
+			if (db0 >= argc) {
+				return showusage (1);
+			}
+			break;
+		case 'V': return (argc < 3)? showusage (1): verify (argv[2]);
+		case '-':
+			if (!strcmp (arg, "--verify")) {
+				return (argc < 3)? showusage (1): verify (argv[2]);
+			}
+			eprintf ("Invalid flag %s\n", arg);
+			break;
 		case 'J':
 			options |= SDB_OPTION_JOURNAL;
 			db0++;
@@ -10,8 +10,8 @@ SDB_API int sdb_num_exists (Sdb *s, const char *key) {
 }
 
 SDB_API ut64 sdb_num_get(Sdb *s, const char *key, ut32 *cas) {
-	const char *v = sdb_const_get (s, key, cas);
-	return (!v || *v == '-') ? 0LL : sdb_atoi (v);
+	SdbKey k = sdb_key (key);
+	return key? sdb_num_get_key (s, &k, cas): 0LL;
 }
 
 SDB_API int sdb_num_add(Sdb *s, const char *key, ut64 v, ut32 cas) {
@@ -22,26 +22,33 @@ SDB_API int sdb_num_add(Sdb *s, const char *key, ut64 v, ut32 cas) {
 }
 
 SDB_API int sdb_num_set(Sdb *s, const char *key, ut64 v, ut32 cas) {
-	char *val, b[SDB_NUM_BUFSZ];
-	int numbase = sdb_num_base (sdb_const_get (s, key, NULL));
-	val = sdb_itoa (v, b, numbase);
-	return sdb_set (s, key, val, cas);
+	SdbKey k = sdb_key (key);
+	return key? sdb_num_set_key (s, &k, v, cas): 0;
 }
 
+// the key is hashed once for both lookups
 SDB_API ut64 sdb_num_inc(Sdb *s, const char *key, ut64 n2, ut32 cas) {
+	SdbKey k = sdb_key (key);
 	ut32 c;
-	ut64 n = sdb_num_get (s, key, &c);
+	if (!key) {
+		return 0LL;
+	}
+	ut64 n = sdb_num_get_key (s, &k, &c);
 	ut64 res = n + n2;
 	if ((cas && c != cas) || res < n) {
 		return 0LL;
 	}
-	sdb_num_set (s, key, res, cas);
+	sdb_num_set_key (s, &k, res, cas);
 	return res;
 }
 
 SDB_API ut64 sdb_num_dec(Sdb *s, const char *key, ut64 n2, ut32 cas) {
+	SdbKey k = sdb_key (key);
 	ut32 c;
-	ut64 n = sdb_num_get (s, key, &c);
+	if (!key) {
+		return 0LL;
+	}
+	ut64 n = sdb_num_get_key (s, &k, &c);
 	if (cas && c != cas) {
 		return 0LL;
 	}
@@ -50,7 +57,7 @@ SDB_API ut64 sdb_num_dec(Sdb *s, const char *key, ut64 n2, ut32 cas) {
 		return 0LL; // XXX must be -1LL?
 	}
 	n -= n2;
-	sdb_num_set (s, key, n, cas);
+	sdb_num_set_key (s, &k, n, cas);
 	return n;
 }
 
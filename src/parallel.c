@@ -0,0 +1,140 @@
+/* sdb - MIT - Copyright 2018 - pancake */
+
+#include <string.h>
+#include <stdlib.h>
+#include "sdb.h"
+#include "thread.h"
+
+typedef struct {
+	Sdb *s;
+	SdbForeachCallback cb;
+	SdbForeachFork fork;
+	void *user;
+	void **tusers;
+	ut32 *bounds;
+	int n;
+	int stop; // see sdb_th_load
+} SdbParallel;
+
+static inline SdbKv *kv_at(SdbHt *ht, HtBucket *bt, ut32 i) {
+	return (SdbKv *)((char *)bt->arr + i * ht->elem_size);
+}
+
+/* split [c->pos, c->end) in n record aligned ranges of similar size. every
+ * record is referenced from the hash tables, so their slots give us valid
+ * record starts without walking the data section */
+static void split_ranges(Sdb *s, SdbCursor *c, ut32 *bounds, int n) {
+	ut32 hpos, p, len = c->end - c->pos;
+	char *map = s->db.map;
+	int k;
+	bounds[0] = c->pos;
+	for (k = 1; k <= n; k++) {
+		bounds[k] = c->end;
+	}
+	if (n < 2 || !map || len < 1 || s->db.size < 4) {
+		return;
+	}
+	ut32_unpack (map, &hpos);
+	for (; hpos + 8 <= s->db.size; hpos += 8) {
+		ut32_unpack ((char *)map + hpos + 4, &p);
+		if (p < c->pos || p >= c->end) {
+			continue;
+		}
+		k = (int)(((ut64)(p - c->pos) * n) / len);
+		if (k > 0 && k < n && p < bounds[k]) {
+			bounds[k] = p;
+		}
+	}
+	for (k = n - 1; k > 0; k--) {
+		if (bounds[k] > bounds[k + 1]) {
+			bounds[k] = bounds[k + 1];
+		}
+	}
+}
+
+static void parallel_worker(void *user, int idx) {
+	SdbParallel *par = user;
+	Sdb *s = par->s;
+	void *tuser = par->tusers[idx];
+	const char *k, *v;
+	bool found;
+	SdbCursor c;
+	ut32 i, j, from, to, pos;
+
+	sdb_cursor_begin (s, &c);
+	c.pos = par->bounds[idx];
+	c.end = par->bounds[idx + 1];
+	for (pos = c.pos; !sdb_th_load (par->stop) && sdb_cursor_next (s, &c, &k, &v, NULL); pos = c.pos) {
+		/* memory entries shadow the disk ones and are visited below */
+		sdb_ht_find_kvp (s->ht, k, &found);
+		if (!found && !sdb_disk_expired (s, pos) && !par->cb (tuser, k, v)) {
+			sdb_th_store (par->stop, 1);
+		}
+	}
+	sdb_cursor_end (s, &c);
+	from = (ut32)(((ut64)s->ht->size * idx) / par->n);
+	to = (ut32)(((ut64)s->ht->size * (idx + 1)) / par->n);
+	for (i = from; i < to && !sdb_th_load (par->stop); i++) {
+		HtBucket *bt = &s->ht->table[i];
+		for (j = 0; j < bt->count && !sdb_th_load (par->stop); j++) {
+			SdbKv *kv = kv_at (s->ht, bt, j);
+			if (sdbkv_value_len (kv) > 0) {
+				if (!par->cb (tuser, sdbkv_key (kv), sdbkv_value (kv))) {
+					sdb_th_store (par->stop, 1);
+				}
+			}
+		}
+	}
+}
+
+SDB_API bool sdb_foreach_reduce(Sdb *s, SdbForeachCallback cb, SdbForeachFork fork, SdbForeachJoin join, void *user, int nthreads) {
+	SdbParallel par = {0};
+	SdbCursor c;
+	int i;
+	if (!s || !cb) {
+		return false;
+	}
+	if (nthreads < 1) {
+		nthreads = sdb_th_ncpu ();
+	}
+	if (nthreads > SDB_TH_MAX) {
+		nthreads = SDB_TH_MAX;
+	}
+	if (s->fd != -1 && !s->db.map) {
+		nthreads = 1; // the page cache of unmapped files is not shared
+	}
+	par.s = s;
+	par.cb = cb;
+	par.fork = fork;
+	par.user = user;
+	par.n = nthreads;
+	par.bounds = calloc (nthreads + 1, sizeof (ut32));
+	par.tusers = calloc (nthreads, sizeof (void *));
+	if (!par.bounds || !par.tusers) {
+		free (par.bounds);
+		free (par.tusers);
+		return false;
+	}
+	for (i = 0; i < nthreads; i++) {
+		par.tusers[i] = fork? fork (user): user;
+	}
+	s->depth++;
+	sdb_cursor_begin (s, &c);
+	split_ranges (s, &c, par.bounds, nthreads);
+	if (!sdb_th_run (nthreads, parallel_worker, &par)) {
+		par.stop = 1;
+	}
+	s->depth--;
+	if (join) {
+		for (i = 0; i < nthreads; i++) {
+			join (user, par.tusers[i]);
+		}
+	}
+	free (par.bounds);
+	free (par.tusers);
+	return !par.stop;
+}
+
+SDB_API bool sdb_foreach_parallel(Sdb *s, SdbForeachCallback cb, void *user, int nthreads) {
+	return sdb_foreach_reduce (s, cb, NULL, NULL, user, nthreads);
+}
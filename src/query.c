@@ -327,13 +327,7 @@ next_quote:
 		} else
 		if (!strcmp (cmd, "*")) {
 			ForeachListUser user = { out, encode, NULL };
-			SdbList *list = sdb_foreach_list (s, true);
-			SdbListIter *iter;
-			SdbKv *kv;
-			ls_foreach (list, iter, kv) {
-				foreach_list_cb (&user, sdbkv_key (kv), sdbkv_value (kv));
-			}
-			ls_free (list);
+			sdb_range (s, NULL, NULL, foreach_list_cb, &user);
 			goto fail;
 		}
 	}
@@ -23,6 +23,28 @@ static inline SdbKv *prev_kv(SdbHt *ht, SdbKv *kv) {
 #define BUCKET_FOREACH(ht, bt, j, kv)					\
 	for ((j) = 0, (kv) = (SdbKv *)(bt)->arr; j < (bt)->count; (j)++, (kv) = next_kv (ht, kv))
 
+/* numbers keep a buffer of SDB_NUM_BUFSZ whatever they render to */
+static inline ut32 kv_vlen(SdbKv *kv) {
+	return kv->nbase? SDB_NUM_BUFSZ: kv->base.value_len;
+}
+
+static inline ut64 kv_size(SdbKv *kv) {
+	return sizeof (SdbKv) + sdbkv_key_len (kv) + kv_vlen (kv) + 2;
+}
+
+static inline void mem_sub(Sdb *s, SdbKv *kv) {
+	ut64 n = kv_size (kv);
+	s->mem = s->mem > n? s->mem - n: 0;
+}
+
+/* sdb_set_internal modes */
+#define SET_OWNED  1 // take the value buffer
+#define SET_QUIET  2 // no journal or hooks, the batch does them once
+#define SET_NODISK 4 // the key is known to be missing from the file
+
+static ut32 sdb_set_internal(Sdb* s, const SdbKey *k, char *val, ut32 vlen, int mode, ut32 cas);
+static void timer_push(Sdb *s, const char *key, ut64 expire);
+
 static inline int nextcas(void) {
 	static ut32 cas = 1;
 	if (!cas) {
@@ -31,6 +53,15 @@ static inline int nextcas(void) {
 	return cas++;
 }
 
+static void sdb_timers_free(Sdb *s) {
+	ut32 i;
+	for (i = 0; i < s->ntimers; i++) {
+		free (s->timers[i].key);
+	}
+	R_FREE (s->timers);
+	s->ntimers = s->mtimers = 0;
+}
+
 static SdbHook global_hook = NULL;
 static void* global_user = NULL;
 
@@ -50,6 +81,7 @@ SDB_API Sdb* sdb_new(const char *path, const char *name, int lock) {
 		return NULL;
 	}
 	s->db.fd = -1;
+	s->db.nomap = !USE_MMAN;
 	s->fd = -1;
 	s->refs = 1;
 	if (path && !*path) {
@@ -94,6 +126,7 @@ SDB_API Sdb* sdb_new(const char *path, const char *name, int lock) {
 	}
 	s->journal = -1;
 	s->fdump = -1;
+	s->zfd = -1;
 	s->depth = 0;
 	s->ndump = NULL;
 	s->ns = ls_new (); // TODO: should be NULL
@@ -148,8 +181,9 @@ SDB_API bool sdb_merge(Sdb* d, Sdb *s) {
 SDB_API bool sdb_isempty(Sdb *s) {
 	if (s) {
 		if (s->db.fd != -1) {
-			sdb_dump_begin (s);
-			while (sdb_dump_hasnext (s)) {
+			SdbCursor c;
+			sdb_cursor_begin (s, &c);
+			if (sdb_cursor_hasnext (s, &c)) {
 				return false;
 			}
 		}
@@ -164,8 +198,9 @@ SDB_API int sdb_count(Sdb *s) {
 	int count = 0;
 	if (s) {
 		if (s->db.fd != -1) {
-			sdb_dump_begin (s);
-			while (sdb_dump_hasnext (s)) {
+			SdbCursor c;
+			sdb_cursor_begin (s, &c);
+			while (sdb_cursor_hasnext (s, &c)) {
 				count++;
 			}
 		}
@@ -187,18 +222,30 @@ static void sdb_fini(Sdb* s, int donull) {
 	}
 	sdb_ns_free (s);
 	s->refs = 0;
+	sdb_journal_close (s); // needs the name
 	free (s->name);
 	free (s->path);
 	ls_free (s->ns);
 	sdb_ht_free (s->ht);
-	sdb_journal_close (s);
+	R_FREE (s->order);
+	s->norder = 0;
+	sdb_timers_free (s);
+	R_FREE (s->ttl);
+	R_FREE (s->cache);
+	R_FREE (s->vbuf);
+	s->vsize = 0;
+	s->nttl = s->mttl = 0;
 	if (s->fd != -1) {
 		close (s->fd);
 		s->fd = -1;
 	}
 	free (s->ndump);
+	free (s->zpath);
 	free (s->dir);
+	free (sdbkv_key (&s->tmpkv));
 	free (sdbkv_value (&s->tmpkv));
+	s->tmpkv.base.key = NULL;
+	s->tmpkv.base.value = NULL;
 	s->tmpkv.base.value_len = 0;
 	if (donull) {
 		memset (s, 0, sizeof (Sdb));
@@ -219,8 +266,83 @@ SDB_API bool sdb_free(Sdb* s) {
 	return false;
 }
 
-SDB_API const char *sdb_const_get_len(Sdb* s, const char *key, int *vlen, ut32 *cas) {
-	ut32 pos, len, keylen;
+/* compares len bytes of the file at pos, mapped or not */
+static bool disk_eq(Sdb *s, ut32 pos, const char *buf, ut32 len) {
+	char tmp[64];
+	if (s->db.map) {
+		return !memcmp (s->db.map + pos, buf, len);
+	}
+	while (len > 0) {
+		ut32 n = R_MIN (len, sizeof (tmp));
+		if (!cdb_read (&s->db, tmp, n, pos) || memcmp (tmp, buf, n)) {
+			return false;
+		}
+		pos += n;
+		buf += n;
+		len -= n;
+	}
+	return true;
+}
+
+/* unmapped files return their values from s->vbuf, valid until the next
+ * disk lookup. len counts the trailing zero */
+static const char *disk_value(Sdb *s, ut32 pos, ut32 len) {
+	if (len > s->vsize) {
+		char *buf = realloc (s->vbuf, len);
+		if (!buf) {
+			return NULL;
+		}
+		s->vbuf = buf;
+		s->vsize = len;
+	}
+	if (!cdb_read (&s->db, s->vbuf, len, pos) || s->vbuf[len - 1]) {
+		return NULL;
+	}
+	return s->vbuf;
+}
+
+/* bytes of a key in the records, sorted files keep their keys apart */
+static inline ut32 disk_klen(Sdb *s, ut32 klen) {
+	return cdb_sorted (&s->db)? 1: klen + 1;
+}
+
+/* look key up in the file, hot keys skip the cdb probe through s->cache.
+ * the cache is only filled outside of scans (s->depth == 0) */
+static bool disk_find(Sdb *s, const SdbKey *k, ut32 *pos, ut32 *dlen) {
+	const char *key = k->ptr;
+	ut32 klen = k->len, hash = k->hash;
+	struct cdb_find_ctx f;
+	SdbCache *c = NULL;
+	if (s->fd == -1 || !cdb_loaded (&s->db)) {
+		return false;
+	}
+	if (s->cache && !cdb_sorted (&s->db)) {
+		c = &s->cache[hash & (SDB_CACHE_SIZE - 1)];
+		if (c->klen == klen + 1 && c->hash == hash &&
+				disk_eq (s, c->pos + KVLSZ, key, klen)) {
+			*pos = c->pos;
+			*dlen = c->dlen;
+			return true;
+		}
+	}
+	cdb_find_init (&f);
+	if (cdb_find (&s->db, &f, hash, key, klen) < 1 || f.dpos < disk_klen (s, klen) + KVLSZ) {
+		return false;
+	}
+	*pos = f.dpos - disk_klen (s, klen) - KVLSZ;
+	*dlen = f.dlen;
+	if (c && !s->depth) { // scans may run in several threads, read only
+		c->hash = hash;
+		c->pos = *pos;
+		c->klen = klen + 1;
+		c->dlen = f.dlen;
+	}
+	return true;
+}
+
+SDB_API const char *sdb_const_get_key(Sdb* s, const SdbKey *k, int *vlen, ut32 *cas) {
+	ut32 pos, rpos, len;
+	const char *val;
 	ut64 now = 0LL;
 	SdbKv *kv;
 	bool found;
@@ -231,16 +353,14 @@ SDB_API const char *sdb_const_get_len(Sdb* s, const char *key, int *vlen, ut32 *
 	if (vlen) {
 		*vlen = 0;
 	}
-	if (!s || !key) {
+	if (!s || !k || !k->ptr) {
 		return NULL;
 	}
-	// TODO: optimize, iterate once
-	keylen = strlen (key);
 
 	/* search in memory */
-	kv = (SdbKv*) sdb_ht_find_kvp (s->ht, key, &found);
+	kv = sdb_ht_find_key (s->ht, k, &found);
 	if (found) {
-		if (!sdbkv_value (kv) || !*sdbkv_value (kv)) {
+		if (!sdbkv_value (kv) || !sdbkv_value_len (kv)) {
 			return NULL;
 		}
 		if (s->timestamped && kv->expire) {
@@ -248,7 +368,9 @@ SDB_API const char *sdb_const_get_len(Sdb* s, const char *key, int *vlen, ut32 *
 				now = sdb_now ();
 			}
 			if (now > kv->expire) {
-				sdb_unset (s, key, 0);
+				if (!s->depth) { // scans may run in several threads, read only
+					sdb_set_internal (s, k, NULL, 0, 0, 0); // unset, reusing the hash
+				}
 				return NULL;
 			}
 		}
@@ -258,25 +380,51 @@ SDB_API const char *sdb_const_get_len(Sdb* s, const char *key, int *vlen, ut32 *
 		if (vlen) {
 			*vlen = sdbkv_value_len (kv);
 		}
+		if (!s->depth) {
+			kv->ref = 1;
+		}
 		return sdbkv_value (kv);
 	}
 	/* search in disk */
-	if (s->fd == -1) {
+	if (!disk_find (s, k, &rpos, &len)) {
+		return NULL;
+	}
+	if (len < SDB_MIN_VALUE || len >= SDB_MAX_VALUE) {
 		return NULL;
 	}
-	(void) cdb_findstart (&s->db);
-	if (cdb_findnext (&s->db, s->ht->hashfn (key), key, keylen) < 1) {
+	if ((s->options & SDB_OPTION_VERIFY) && !cdb_check (&s->db, rpos)) {
 		return NULL;
 	}
-	len = cdb_datalen (&s->db);
-	if (len < SDB_MIN_VALUE || len >= SDB_MAX_VALUE) {
+	pos = rpos + KVLSZ + disk_klen (s, k->len);
+	if (s->db.nsect) {
+		ut64 expire = sdb_disk_expire (s, rpos);
+		if (expire && sdb_now () > expire) {
+			return NULL;
+		}
+	}
+	if (s->db.map) {
+		val = s->db.map + pos;
+	} else if (!(val = disk_value (s, pos, len))) {
+		return NULL;
+	}
+	/* decoded into the file's block cache, not safe from parallel scans */
+	if (cdb_compressed (&s->db) && !(val = cdb_zvalue (&s->db, val, len, &len, NULL))) {
 		return NULL;
 	}
 	if (vlen) {
-		*vlen = len;
+		*vlen = len - 1;
 	}
-	pos = cdb_datapos (&s->db);
-	return s->db.map + pos;
+	return val;
+}
+
+SDB_API const char *sdb_const_get_keylen(Sdb* s, const char *key, ut32 klen, int *vlen, ut32 *cas) {
+	SdbKey k = sdb_key_len (key, klen);
+	return key? sdb_const_get_key (s, &k, vlen, cas): NULL;
+}
+
+SDB_API const char *sdb_const_get_len(Sdb* s, const char *key, int *vlen, ut32 *cas) {
+	SdbKey k = sdb_key (key);
+	return sdb_const_get_key (s, &k, vlen, cas);
 }
 
 SDB_API const char *sdb_const_get(Sdb* s, const char *key, ut32 *cas) {
@@ -286,8 +434,21 @@ SDB_API const char *sdb_const_get(Sdb* s, const char *key, ut32 *cas) {
 // TODO: add sdb_getf?
 
 SDB_API char *sdb_get_len(Sdb* s, const char *key, int *vlen, ut32 *cas) {
-	const char *value = sdb_const_get_len (s, key, vlen, cas);
-	return value ? strdup (value) : NULL;
+	int len = 0;
+	const char *value = sdb_const_get_len (s, key, &len, cas);
+	char *res;
+	if (!value) {
+		return NULL;
+	}
+	res = malloc (len + 1);
+	if (res) {
+		memcpy (res, value, len);
+		res[len] = 0;
+	}
+	if (vlen) {
+		*vlen = len;
+	}
+	return res;
 }
 
 SDB_API char *sdb_get(Sdb* s, const char *key, ut32 *cas) {
@@ -299,8 +460,20 @@ SDB_API int sdb_unset(Sdb* s, const char *key, ut32 cas) {
 }
 
 /* remove from memory */
+static bool remove_key(Sdb *s, const SdbKey *k) {
+	bool found;
+	SdbKv *kv = sdb_ht_find_key (s->ht, k, &found);
+	if (!found) {
+		return false;
+	}
+	mem_sub (s, kv);
+	s->reorder = true;
+	return sdb_ht_delete_key (s->ht, k);
+}
+
 SDB_API bool sdb_remove(Sdb *s, const char *key, ut32 cas) {
-	return sdb_ht_delete (s->ht, key);
+	SdbKey k = sdb_key (key);
+	return key? remove_key (s, &k): false;
 }
 
 // alias for '-key=str'.. '+key=str' concats
@@ -359,28 +532,22 @@ SDB_API int sdb_add(Sdb* s, const char *key, const char *val, ut32 cas) {
 }
 
 SDB_API bool sdb_exists(Sdb* s, const char *key) {
-	ut32 pos;
-	char ch;
+	ut32 pos, dlen;
 	SdbKv *kv;
 	bool found;
-	int klen = strlen (key) + 1;
-	if (!s) {
+	if (!s || !key) {
 		return false;
 	}
 	kv = (SdbKv*)sdb_ht_find_kvp (s->ht, key, &found);
 	if (found && kv) {
-		return *sdbkv_value (kv);
+		return sdbkv_value_len (kv) > 0;
 	}
-	if (s->fd == -1) {
+	SdbKey k = sdb_key (key);
+	if (!disk_find (s, &k, &pos, &dlen) || sdb_disk_expired (s, pos)) {
 		return false;
 	}
-	(void)cdb_findstart (&s->db);
-	if (cdb_findnext (&s->db, sdb_hash (key), key, klen)) {
-		pos = cdb_datapos (&s->db);
-		cdb_read (&s->db, &ch, 1, pos);
-		return ch != 0;
-	}
-	return false;
+	/* an empty value is its terminator, after a zero stub in compressed files */
+	return dlen > (cdb_compressed (&s->db)? 2: 1);
 }
 
 SDB_API int sdb_open(Sdb *s, const char *file) {
@@ -413,6 +580,12 @@ SDB_API int sdb_open(Sdb *s, const char *file) {
 	if (s->fd != -1) {
 		cdb_init (&s->db, s->fd);
 	}
+	if (s->cache) {
+		memset (s->cache, 0, SDB_CACHE_SIZE * sizeof (SdbCache));
+	} else if (s->fd != -1) {
+		/* allocated here, parallel readers must not race to create it */
+		s->cache = calloc (SDB_CACHE_SIZE, sizeof (SdbCache));
+	}
 	return s->fd;
 }
 
@@ -439,6 +612,9 @@ SDB_API void sdb_reset(Sdb* s) {
 	/* empty memory hashtable */
 	sdb_ht_free (s->ht);
 	s->ht = sdb_ht_new ();
+	s->reorder = true;
+	s->mem = s->mem_floor = 0;
+	sdb_timers_free (s);
 }
 
 static char lastChar(const char *str) {
@@ -517,7 +693,8 @@ SDB_API SdbKv* sdbkv_new2(const char *k, int kl, const char *v, int vl) {
 			free (kv);
 			return NULL;
 		}
-		memcpy (kv->base.value, v, vl + 1);
+		memcpy (kv->base.value, v, vl);
+		((char *)kv->base.value)[vl] = 0;
 	} else {
 		kv->base.value = NULL;
 		kv->base.value_len = 0;
@@ -535,11 +712,81 @@ SDB_API void sdbkv_free(SdbKv *kv) {
 	}
 }
 
-static ut32 sdb_set_internal(Sdb* s, const char *key, char *val, int owned, ut32 cas) {
-	ut32 vlen, klen;
+// true if the key is stored in the disk database
+static bool sdb_disk_has(Sdb *s, const SdbKey *k) {
+	ut32 pos, dlen;
+	return disk_find (s, k, &pos, &dlen);
+}
+
+/* expire time stored in the file for key, 0 if none */
+static ut64 disk_key_expire(Sdb *s, const SdbKey *k) {
+	ut32 pos, dlen;
+	if (s->fd == -1 || !cdb_section (&s->db, CDB_SECT_TTL, NULL)) {
+		return 0LL;
+	}
+	if (!disk_find (s, k, &pos, &dlen)) {
+		return 0LL;
+	}
+	return sdb_disk_expire (s, pos);
+}
+
+/* CLOCK sweep over the memory table. recently used entries get a second
+ * chance, dirty ones are kept unless there is no file to write them to */
+static void sdb_evict(Sdb *s) {
+	bool lossy = !s->name && !s->dir;
+	ut32 j, steps;
+	if (s->depth) {
+		return; // iterators point into the table
+	}
+	for (steps = 0; s->mem > s->mem_limit && steps < 2 * s->ht->size; steps++) {
+		if (s->hand >= s->ht->size) {
+			s->hand = 0;
+		}
+		HtBucket *bt = &s->ht->table[s->hand++];
+		for (j = 0; j < bt->count && s->mem > s->mem_limit;) {
+			SdbKv *kv = (SdbKv *)((char *)bt->arr + j * s->ht->elem_size);
+			if (kv->ref || (!kv->clean && !lossy)) {
+				kv->ref = 0;
+				j++;
+				continue;
+			}
+			mem_sub (s, kv);
+			s->reorder = true;
+			s->evictions++;
+			sdb_ht_delete (s->ht, sdbkv_key (kv));
+		}
+	}
+	/* write back, unless only entries that cannot be synced are left */
+	if (!lossy && s->mem > s->mem_limit && s->mem - s->mem_floor > s->mem_limit / 2) {
+		sdb_sync (s);
+		s->mem_floor = s->mem;
+	}
+}
+
+static inline void sdb_mem_check(Sdb *s) {
+	if (s->mem_limit && s->mem > s->mem_limit) {
+		sdb_evict (s);
+	}
+}
+
+SDB_API void sdb_memory_limit(Sdb *s, ut64 bytes) {
+	s->mem_limit = bytes;
+	s->mem_floor = 0;
+	sdb_mem_check (s);
+}
+
+/* val holds vlen bytes, owned buffers must also have a terminator at val[vlen] */
+static ut32 sdb_set_internal(Sdb* s, const SdbKey *k, char *val, ut32 vlen, int mode, ut32 cas) {
+	const char *key = k->ptr;
+	ut32 klen = k->len;
+	bool owned = mode & SET_OWNED;
+	bool quiet = mode & SET_QUIET;
 	SdbKv *kv;
 	bool found;
 	if (!s || !key) {
+		if (owned) {
+			free (val);
+		}
 		return 0;
 	}
 	if (!val) {
@@ -548,50 +795,68 @@ static ut32 sdb_set_internal(Sdb* s, const char *key, char *val, int owned, ut32
 		} else {
 			val = "";
 		}
+		vlen = 0;
 	}
-	// XXX strlen computed twice.. because of check_*()
-	klen = strlen (key);
-	vlen = strlen (val);
 	if (klen >= SDB_KSZ || vlen >= SDB_VSZ) {
 		if (owned) {
 			free (val);
 		}
 		return 0;
 	}
-	if (s->journal != -1) {
-		sdb_journal_log (s, key, val);
+	if (s->journal != -1 && !quiet) {
+		sdb_journal_log_bin (s, key, (const ut8 *)val, vlen);
 	}
-	cdb_findstart (&s->db);
-	kv = sdb_ht_find_kvp (s->ht, key, &found);
+	kv = sdb_ht_find_key (s->ht, k, &found);
 	if (found && sdbkv_value (kv)) {
-		if (cdb_findnext (&s->db, sdb_hash (key), key, klen)) {
-			if (cas && kv->cas != cas) {
-				if (owned) {
-					free (val);
-				}
-				return 0;
+		if (cas && kv->cas != cas) {
+			if (owned) {
+				free (val);
 			}
-			if (vlen == sdbkv_value_len (kv) && !strcmp (sdbkv_value (kv), val)) {
+			return 0;
+		}
+		if (vlen == sdbkv_value_len (kv) && !memcmp (sdbkv_value (kv), val, vlen)) {
+			if (!quiet) {
 				sdb_hook_call (s, key, val);
-				return kv->cas;
 			}
-			kv->cas = cas = nextcas ();
 			if (owned) {
-				kv->base.value_len = vlen;
-				free (kv->base.value);
-				kv->base.value = val; // owned
-			} else {
-				if ((ut32)vlen > kv->base.value_len) {
-					free (kv->base.value);
-					kv->base.value = malloc (vlen + 1);
-				}
-				memcpy (kv->base.value, val, vlen + 1);
-				kv->base.value_len = vlen;
+				free (val);
+			}
+			return kv->cas;
+		}
+		if (!vlen && !sdb_disk_has (s, k)) {
+			// nothing to shadow on disk, drop the entry instead of keeping an empty one
+			remove_key (s, k);
+			if (owned) {
+				free (val);
 			}
+			if (!quiet) {
+				sdb_hook_call (s, key, "");
+			}
+			return nextcas ();
+		}
+		kv->cas = cas = nextcas ();
+		kv->ref = 1;
+		kv->clean = 0;
+		s->mem += vlen;
+		s->mem -= kv_vlen (kv);
+		kv->nbase = 0;
+		if (owned) {
+			kv->base.value_len = vlen;
+			free (kv->base.value);
+			kv->base.value = val; // owned
 		} else {
-			sdb_ht_delete (s->ht, key);
+			if ((ut32)vlen > kv->base.value_len) {
+				free (kv->base.value);
+				kv->base.value = malloc (vlen + 1);
+			}
+			memcpy (kv->base.value, val, vlen);
+			((char *)kv->base.value)[vlen] = 0;
+			kv->base.value_len = vlen;
+		}
+		if (!quiet) {
+			sdb_hook_call (s, key, val);
 		}
-		sdb_hook_call (s, key, val);
+		sdb_mem_check (s);
 		return cas;
 	}
 	// empty values are also stored
@@ -607,9 +872,37 @@ static ut32 sdb_set_internal(Sdb* s, const char *key, char *val, int owned, ut32
 	}
 	if (kv) {
 		ut32 cas = kv->cas = nextcas ();
-		sdb_ht_insert_kvp (s->ht, kv, true /*update*/);
+		kv->ref = 1;
+		/* one probe tells if the file has the same value and its ttl */
+		if (!(mode & SET_NODISK) && (s->mem_limit || cdb_section (&s->db, CDB_SECT_TTL, NULL))) {
+			ut32 pos, dlen;
+			if (disk_find (s, k, &pos, &dlen)) {
+				/* keep the ttl the key had on disk, unless it already passed.
+				 * then the disk copy is gone and this value is not clean */
+				ut64 expire = sdb_disk_expire (s, pos);
+				if (expire && expire <= sdb_now ()) {
+					expire = 0;
+				} else {
+					/* stubs of compressed files are not compared */
+					kv->clean = s->mem_limit && !cdb_compressed (&s->db) && dlen == vlen + 1 &&
+						disk_eq (s, pos + KVLSZ + disk_klen (s, klen), val, vlen);
+				}
+				kv->expire = expire;
+			}
+		}
+		if (kv->expire) {
+			kv->clean = 0;
+			s->timestamped = true;
+			timer_push (s, key, kv->expire); // sdb_expire_tick reclaims it
+		}
+		sdb_ht_insert_key (s->ht, k, kv, true /*update*/);
+		s->reorder = true;
+		s->mem += kv_size (kv);
 		free (kv);
-		sdb_hook_call (s, key, val);
+		if (!quiet) {
+			sdb_hook_call (s, key, val);
+		}
+		sdb_mem_check (s);
 		return cas;
 	}
 // kv set failed, no need to callback	sdb_hook_call (s, key, val);
@@ -617,11 +910,148 @@ static ut32 sdb_set_internal(Sdb* s, const char *key, char *val, int owned, ut32
 }
 
 SDB_API int sdb_set_owned(Sdb* s, const char *key, char *val, ut32 cas) {
-	return sdb_set_internal (s, key, val, 1, cas);
+	SdbKey k = sdb_key (key);
+	return sdb_set_internal (s, &k, val, val? strlen (val): 0, SET_OWNED, cas);
 }
 
 SDB_API int sdb_set(Sdb* s, const char *key, const char *val, ut32 cas) {
-	return sdb_set_internal (s, key, (char*)val, 0, cas);
+	SdbKey k = sdb_key (key);
+	return sdb_set_internal (s, &k, (char*)val, val? strlen (val): 0, 0, cas);
+}
+
+/* klen must be strlen (key), callers that set the same key often can keep
+ * the SdbKey around and use sdb_set_key to skip hashing it again */
+SDB_API int sdb_set_len(Sdb* s, const char *key, ut32 klen, const char *val, ut32 cas) {
+	SdbKey k = sdb_key_len (key, klen);
+	return key? sdb_set_internal (s, &k, (char*)val, val? strlen (val): 0, 0, cas): 0;
+}
+
+SDB_API int sdb_set_key(Sdb* s, const SdbKey *key, const char *val, ut32 cas) {
+	return key? sdb_set_internal (s, key, (char*)val, val? strlen (val): 0, 0, cas): 0;
+}
+
+/* the number of a memory entry that was set with sdb_num_set_key, the
+ * others are parsed from their value */
+SDB_API ut64 sdb_num_get_key(Sdb* s, const SdbKey *k, ut32 *cas) {
+	const char *v;
+	bool found;
+	SdbKv *kv;
+	if (!s || !k || !k->ptr) {
+		return 0LL;
+	}
+	kv = sdb_ht_find_key (s->ht, k, &found);
+	if (found && kv->nbase && !(s->timestamped && kv->expire)) {
+		if (cas) {
+			*cas = kv->cas;
+		}
+		if (!s->depth) {
+			kv->ref = 1;
+		}
+		return kv->num;
+	}
+	v = sdb_const_get_key (s, k, NULL, cas);
+	return (!v || *v == '-') ? 0LL : sdb_atoi (v);
+}
+
+/* numbers stay in the memory entry as a ut64, their text is rendered in
+ * place in the base the value had. readers may run concurrently, so it is
+ * done here rather than when read. the journal and the hooks want the
+ * whole set path */
+SDB_API int sdb_num_set_key(Sdb* s, const SdbKey *k, ut64 v, ut32 cas) {
+	char *val, b[SDB_NUM_BUFSZ];
+	bool found;
+	SdbKv *kv;
+	int base;
+	if (!s || !k || !k->ptr) {
+		return 0;
+	}
+	kv = sdb_ht_find_key (s->ht, k, &found);
+	bool quiet = s->journal == -1 && (!s->hooks || !ls_length (s->hooks));
+	if (found && kv->nbase && quiet) {
+		if (cas && kv->cas != cas) {
+			return 0;
+		}
+		kv->ref = 1;
+		if (kv->num == v) {
+			return kv->cas;
+		}
+		/* the base sdb_num_base would find in the text, zero is "0" */
+		kv->nbase = (kv->nbase == 16 && kv->num)? 16: 10;
+		kv->num = v;
+		sdbkv_render (kv);
+		kv->clean = 0;
+		return kv->cas = nextcas ();
+	}
+	base = sdb_num_base (sdb_const_get_key (s, k, NULL, NULL));
+	val = sdb_itoa (v, b, base);
+	if (!(cas = sdb_set_internal (s, k, val, strlen (val), 0, cas))) {
+		return 0;
+	}
+	/* from now on the entry holds the number. sdb_itoa drops the leading
+	 * zero of octal, so the text no longer reads back in base 8: keep those
+	 * as text and let the next update parse it */
+	kv = sdb_ht_find_key (s->ht, k, &found);
+	if (found && !kv->nbase && sdbkv_value (kv) && (base == 10 || base == 16)) {
+		char *nv = realloc (kv->base.value, SDB_NUM_BUFSZ);
+		if (nv) {
+			s->mem += SDB_NUM_BUFSZ - kv->base.value_len;
+			kv->base.value = nv;
+			kv->nbase = base;
+			kv->num = v;
+		}
+	}
+	return cas;
+}
+
+/* raw bytes, may contain zeroes. an empty value unsets the key like sdb_set */
+SDB_API int sdb_set_bin(Sdb* s, const char *key, const ut8 *val, ut32 len, ut32 cas) {
+	SdbKey k = sdb_key (key);
+	return sdb_set_internal (s, &k, (char*)val, val? len: 0, 0, cas);
+}
+
+/* one journal write and one hook call for the whole batch, the hooks see
+ * its last pair. returns the number of pairs stored */
+SDB_API int sdb_set_batch(Sdb* s, const SdbKvPair *pairs, size_t n, int flags) {
+	int mode = SET_QUIET;
+	size_t i;
+	int count = 0;
+	if (!s || !pairs || !n) {
+		return 0;
+	}
+	if (flags & SDB_BATCH_NODISK) {
+		mode |= SET_NODISK;
+	}
+	sdb_ht_reserve (s->ht, s->ht->count + n);
+	if (s->journal != -1) {
+		sdb_journal_log_batch (s, pairs, n);
+	}
+	for (i = 0; i < n; i++) {
+		SdbKey k = sdb_key (pairs[i].key);
+		const char *v = pairs[i].value;
+		if (sdb_set_internal (s, &k, (char*)v, v? strlen (v): 0, mode, 0)) {
+			count++;
+		}
+	}
+	sdb_hook_call (s, pairs[n - 1].key, pairs[n - 1].value? pairs[n - 1].value: "");
+	return count;
+}
+
+SDB_API const ut8 *sdb_const_get_bin(Sdb* s, const char *key, ut32 *len, ut32 *cas) {
+	int vlen = 0;
+	const char *value = sdb_const_get_len (s, key, &vlen, cas);
+	if (len) {
+		*len = value? vlen: 0;
+	}
+	return (const ut8 *)value;
+}
+
+SDB_API ut8 *sdb_get_bin(Sdb* s, const char *key, ut32 *len, ut32 *cas) {
+	int vlen = 0;
+	char *value = sdb_get_len (s, key, &vlen, cas);
+	if (len) {
+		*len = value? vlen: 0;
+	}
+	return (ut8 *)value;
 }
 
 static int sdb_foreach_list_cb(void *user, const char *k, const char *v) {
@@ -634,16 +1064,12 @@ static int sdb_foreach_list_cb(void *user, const char *k, const char *v) {
 	return 1;
 }
 
-static int __cmp_asc(const void *a, const void *b) {
-	const SdbKv *ka = a, *kb = b;
-	return strcmp (sdbkv_key (ka), sdbkv_key (kb));
-}
-
 SDB_API SdbList *sdb_foreach_list(Sdb* s, bool sorted) {
 	SdbList *list = ls_newf ((SdbListFree)sdbkv_free);
-	sdb_foreach (s, sdb_foreach_list_cb, list);
 	if (sorted) {
-		ls_sort (list, __cmp_asc);
+		sdb_range (s, NULL, NULL, sdb_foreach_list_cb, list);
+	} else {
+		sdb_foreach (s, sdb_foreach_list_cb, list);
 	}
 	return list;
 }
@@ -685,23 +1111,24 @@ SDB_API SdbList *sdb_foreach_list_filter(Sdb* s, SdbForeachCallback filter, bool
 	}
 	u.filter = filter;
 	u.list = list;
-	sdb_foreach (s, sdb_foreach_list_filter_cb, &u);
 	if (sorted) {
-		ls_sort (list, __cmp_asc);
+		sdb_range (s, NULL, NULL, sdb_foreach_list_filter_cb, &u);
+	} else {
+		sdb_foreach (s, sdb_foreach_list_filter_cb, &u);
 	}
 	return list;
 }
 
 typedef struct {
-	const char *expr;
+	char *key; // expressions are split once, NULL matches anything
+	char *value;
 	SdbList *list;
 	bool single;
 } _match_sdb_user;
 
 static int sdb_foreach_match_cb(void *user, const char *k, const char *v) {
 	_match_sdb_user *o = (_match_sdb_user*)user;
-	SdbKv tkv = { .base.key = (char*)k, .base.value = (char*)v };
-	if (sdbkv_match (&tkv, o->expr)) {
+	if ((!o->key || match (k, o->key)) && (!o->value || match (v, o->value))) {
 		SdbKv *kv = R_NEW0 (SdbKv);
 		kv->base.key = strdup (k);
 		kv->base.value = strdup (v);
@@ -713,25 +1140,54 @@ static int sdb_foreach_match_cb(void *user, const char *k, const char *v) {
 	return 1;
 }
 
-SDB_API SdbList *sdb_foreach_match(Sdb* s, const char *expr, bool single) {
-	SdbList *list = ls_newf ((SdbListFree)sdbkv_free);
-	_match_sdb_user o = { expr, list, single };
-	sdb_foreach (s, sdb_foreach_match_cb, &o);
-#if 0
-	// TODO. add sorted ? wtf
-	if (sorted) {
-		ls_sort (list, __cmp_asc);
+/* smallest string greater than every key starting with prefix */
+static char *prefix_end(const char *prefix) {
+	char *end = strdup (prefix);
+	int len = end? strlen (end): 0;
+	while (len > 0 && (ut8)end[len - 1] == 0xff) {
+		end[--len] = 0;
 	}
-#endif
-	return list;
+	if (!len) {
+		free (end);
+		return NULL;
+	}
+	end[len - 1]++;
+	return end;
 }
 
-static int getbytes(Sdb *s, char *b, int len) {
-	if (!cdb_read (&s->db, b, len, s->pos)) {
-		return -1;
+SDB_API SdbList *sdb_foreach_match(Sdb* s, const char *expr, bool single) {
+	SdbList *list = ls_newf ((SdbListFree)sdbkv_free);
+	char *e = strdup (expr);
+	_match_sdb_user o = { e, NULL, list, single };
+	if (!e) {
+		return list;
 	}
-	s->pos += len;
-	return len;
+	char *eq = strchr (e, '=');
+	if (eq) {
+		*eq++ = 0;
+		o.value = *eq? eq: NULL;
+	}
+	if (!*e) {
+		o.key = NULL;
+	}
+	if (o.key && *o.key == '^' && sdb_index_has (s)) {
+		/* anchored keys only need to walk their range of the index */
+		char *from = strdup (o.key + 1);
+		if (from) {
+			int len = strlen (from);
+			if (len > 0 && from[len - 1] == '$') {
+				from[len - 1] = 0;
+			}
+			char *to = prefix_end (from);
+			sdb_index_range (s, from, to, sdb_foreach_match_cb, &o);
+			free (to);
+			free (from);
+		}
+	} else {
+		sdb_foreach (s, sdb_foreach_match_cb, &o);
+	}
+	free (e);
+	return list;
 }
 
 static bool sdb_foreach_end(Sdb *s, bool result) {
@@ -739,33 +1195,39 @@ static bool sdb_foreach_end(Sdb *s, bool result) {
 	return result;
 }
 
-static bool sdb_foreach_cdb(Sdb *s, SdbForeachCallback cb,
-			     SdbForeachCallback cb2, void *user) {
-	char *v = NULL;
-	char k[SDB_MAX_KEY] = {0};
-	bool found;
-	sdb_dump_begin (s);
-	while (sdb_dump_dupnext (s, k, &v, NULL)) {
+static bool sdb_foreach_cdb(Sdb *s, SdbForeachCallback cb, void *user) {
+	const char *k, *v;
+	ut32 pos;
+	bool found, ret = true;
+	SdbCursor c;
+	/* whole file scans read ahead, nested ones keep the outer advice */
+	bool scan = s->depth == 1 && !(s->db.advice & CDB_ADVICE_SEQUENTIAL);
+	if (scan) {
+		cdb_advise (&s->db, (s->db.advice & ~CDB_ADVICE_RANDOM) | CDB_ADVICE_SEQUENTIAL);
+	}
+	sdb_cursor_begin (s, &c);
+	for (pos = c.pos; sdb_cursor_next (s, &c, &k, &v, NULL); pos = c.pos) {
 		SdbKv *kv = sdb_ht_find_kvp (s->ht, k, &found);
+		if (!found && sdb_disk_expired (s, pos)) {
+			continue;
+		}
 		if (found) {
-			free (v);
 			if (kv && sdbkv_key (kv) && sdbkv_value (kv)) {
 				if (!cb (user, sdbkv_key (kv), sdbkv_value (kv))) {
-					return false;
-				}
-				if (cb2) {
-					cb2 (user, k, sdbkv_value (kv));
+					ret = false;
+					break;
 				}
 			}
-		} else {
-			if (!cb (user, k, v)) {
-				free (v);
-				return false;
-			}
-			free (v);
+		} else if (!cb (user, k, v)) {
+			ret = false;
+			break;
 		}
 	}
-	return true;
+	sdb_cursor_end (s, &c);
+	if (scan) {
+		cdb_advise (&s->db, s->db.advice & ~CDB_ADVICE_WILLNEED);
+	}
+	return ret;
 }
 
 SDB_API bool sdb_foreach(Sdb* s, SdbForeachCallback cb, void *user) {
@@ -774,7 +1236,7 @@ SDB_API bool sdb_foreach(Sdb* s, SdbForeachCallback cb, void *user) {
 		return false;
 	}
 	s->depth++;
-	result = sdb_foreach_cdb (s, cb, NULL, user);
+	result = sdb_foreach_cdb (s, cb, user);
 	if (!result) {
 		return sdb_foreach_end (s, false);
 	}
@@ -786,7 +1248,7 @@ SDB_API bool sdb_foreach(Sdb* s, SdbForeachCallback cb, void *user) {
 		ut32 j;
 
 		BUCKET_FOREACH (s->ht, bt, j, kv) {
-			if (kv && sdbkv_value (kv) && *sdbkv_value (kv)) {
+			if (kv && sdbkv_value_len (kv) > 0) {
 				if (!cb (user, sdbkv_key (kv), sdbkv_value (kv))) {
 					return sdb_foreach_end (s, false);
 				}
@@ -796,35 +1258,40 @@ SDB_API bool sdb_foreach(Sdb* s, SdbForeachCallback cb, void *user) {
 	return sdb_foreach_end (s, true);
 }
 
-static int _insert_into_disk(void *user, const char *key, const char *value) {
-	Sdb *s = (Sdb *)user;
-	if (s) {
-		sdb_disk_insert (s, key, value);
-		return true;
-	}
-	return false;
-}
-
-static int _remove_afer_insert(void *user, const char *k, const char *v) {
-	Sdb *s = (Sdb *)user;
-	if (s) {
-		sdb_ht_delete (s->ht, k);
-		return true;
-	}
-	return false;
-}
-
 SDB_API bool sdb_sync(Sdb* s) {
-	bool result;
-	ut32 i;
+	const char *k, *v;
+	SdbCursor c;
+	ut32 i, pos, vlen;
+	ut64 now;
+	bool found;
 
-	if (!s || !sdb_disk_create (s)) {
+	if (!s) {
 		return false;
 	}
-	result = sdb_foreach_cdb (s, _insert_into_disk, _remove_afer_insert, s);
-	if (!result) {
+	sdb_expire_tick (s, 0);
+	now = sdb_now ();
+	if (!sdb_disk_create (s)) {
 		return false;
 	}
+	/* rewrite the disk records, updated by the memory ones */
+	cdb_advise (&s->db, CDB_ADVICE_SEQUENTIAL);
+	sdb_cursor_begin (s, &c);
+	for (pos = c.pos; sdb_cursor_next (s, &c, &k, &v, &vlen); pos = c.pos) {
+		SdbKv *kv = sdb_ht_find_kvp (s->ht, k, &found);
+		if (found) {
+			if (sdbkv_value (kv) && sdbkv_value_len (kv) && (!kv->expire || kv->expire >= now)) {
+				sdb_disk_insert_bin (s, k, (const ut8 *)sdbkv_value (kv), sdbkv_value_len (kv), kv->expire);
+			}
+			sdb_remove (s, k, 0);
+		} else {
+			ut64 expire = sdb_disk_expire (s, pos);
+			if (!expire || expire >= now) {
+				sdb_disk_insert_bin (s, k, (const ut8 *)v, vlen, expire);
+			}
+		}
+	}
+	sdb_cursor_end (s, &c);
+	cdb_advise (&s->db, s->db.advice & ~CDB_ADVICE_WILLNEED);
 
 	/* append new keyvalues */
 	for (i = 0; i < s->ht->size; ++i) {
@@ -833,8 +1300,8 @@ SDB_API bool sdb_sync(Sdb* s) {
 		ut32 j;
 
 		BUCKET_FOREACH (s->ht, bt, j, kv) {
-			if (sdbkv_key (kv) && sdbkv_value (kv) && *sdbkv_value (kv) && !kv->expire) {
-				if (sdb_disk_insert (s, sdbkv_key (kv), sdbkv_value (kv))) {
+			if (sdbkv_key (kv) && sdbkv_value (kv) && sdbkv_value_len (kv)) {
+				if (sdb_disk_insert_bin (s, sdbkv_key (kv), (const ut8 *)sdbkv_value (kv), sdbkv_value_len (kv), kv->expire)) {
 					sdb_remove (s, sdbkv_key (kv), 0);
 					// decrement kv and j, otherwise we skip an element
 					kv = prev_kv (s->ht, kv);
@@ -850,110 +1317,349 @@ SDB_API bool sdb_sync(Sdb* s) {
 	return true;
 }
 
-SDB_API void sdb_dump_begin(Sdb* s) {
+SDB_API void sdb_cursor_begin(Sdb* s, SdbCursor *c) {
+	char buf[4];
+	c->pos = c->end = 0;
+	c->buf = NULL;
+	c->bsize = 0;
+	memset (&c->zb, 0, sizeof (c->zb));
+	c->zb.block = UT32_MAX;
+	c->kc.rec = UT32_MAX;
 	if (s->fd != -1) {
-		s->pos = sizeof (((struct cdb_make *)0)->final);
-		seek_set (s->fd, s->pos);
-	} else {
-		s->pos = 0;
-	}
-}
-
-SDB_API SdbKv *sdb_dump_next(Sdb* s) {
-	char *v = NULL;
-	char k[SDB_MAX_KEY] = {0};
-	int vl = 0;
-	// we dont need to malloc, because all values are null terminated in memory.
-	if (!sdb_dump_dupnext (s, k, &v, &vl)) {
-		return NULL;
+		c->pos = sizeof (((struct cdb_make *)0)->final);
+		/* the first hash table starts right after the last record */
+		if (s->db.eod) {
+			c->end = s->db.eod;
+		} else if (cdb_read (&s->db, buf, sizeof (buf), 0)) {
+			ut32_unpack (buf, &c->end);
+		}
 	}
-	vl--;
-	strncpy (sdbkv_key (&s->tmpkv), k, SDB_KSZ - 1);
-	s->tmpkv.base.key[SDB_KSZ - 1] = '\0';
-	free (sdbkv_value (&s->tmpkv));
-	s->tmpkv.base.value = v;
-	s->tmpkv.base.value_len = vl;
-	return &s->tmpkv;
 }
 
-SDB_API bool sdb_dump_hasnext(Sdb* s) {
+SDB_API bool sdb_cursor_hasnext(Sdb* s, SdbCursor *c) {
 	ut32 k, v;
-	if (!cdb_getkvlen (&s->db, &k, &v, s->pos)) {
+	if (c->pos >= c->end || !cdb_getkvlen (&s->db, &k, &v, c->pos)) {
 		return false;
 	}
 	if (k < 1 || v < 1) {
 		return false;
 	}
-	s->pos += k + v + 4;
+	c->pos += k + v + 4;
 	return true;
 }
 
-SDB_API bool sdb_stats(Sdb *s, ut32 *disk, ut32 *mem) {
-	if (!s) {
+SDB_API void sdb_cursor_end(Sdb* s, SdbCursor *c) {
+	(void)s; // kept for symmetry with sdb_cursor_begin
+	R_FREE (c->buf);
+	c->bsize = 0;
+	cdb_zfree (&c->zb);
+}
+
+/* sdb_cursor_next for unmapped files, the record is copied to c->buf */
+static bool cursor_read(Sdb *s, SdbCursor *c, const char **key, const char **value, ut32 *vlen) {
+	ut32 klen, len, pos = c->pos;
+	if (pos >= c->end || c->end > s->db.size || c->end - pos < KVLSZ) {
 		return false;
 	}
-	if (disk) {
-		ut32 count = 0;
-		if (s->fd != -1) {
-			sdb_dump_begin (s);
-			while (sdb_dump_hasnext (s)) {
-				count ++;
+	if (!cdb_getkvlen (&s->db, &klen, &len, pos)) {
+		return false;
+	}
+	pos += KVLSZ;
+	if (klen < 1 || len < 1 || c->end - pos < klen + len) {
+		return false;
+	}
+	if (key || value) {
+		if (klen + len > c->bsize) {
+			char *buf = realloc (c->buf, klen + len);
+			if (!buf) {
+				return false;
 			}
+			c->buf = buf;
+			c->bsize = klen + len;
+		}
+		if (!cdb_read (&s->db, c->buf, klen + len, pos)) {
+			return false;
+		}
+		if (c->buf[klen - 1] || c->buf[klen + len - 1]) {
+			return false;
 		}
-		*disk = count;
 	}
-	if (mem) {
-		*mem = s->ht->count;
+	c->pos = pos + klen + len;
+	if (key) {
+		*key = c->buf;
+		if (cdb_sorted (&s->db) && !(*key = cdb_kat (&s->db, &c->kc, pos - KVLSZ))) {
+			return false;
+		}
 	}
-	return disk || mem;
+	if (value) {
+		*value = c->buf + klen;
+		if (cdb_compressed (&s->db) && !(*value = cdb_zvalue (&s->db, *value, len, &len, &c->zb))) {
+			return false;
+		}
+	}
+	if (vlen) {
+		*vlen = len - 1;
+	}
+	return true;
 }
 
-// TODO: make it static? internal api?
-SDB_API bool sdb_dump_dupnext(Sdb* s, char *key, char **value, int *_vlen) {
-	ut32 vlen = 0, klen = 0;
+// no copies are made, key and value point into the mapped file and are valid
+// until the database is synced or reopened. unmapped files copy the record
+// into the cursor, valid until the next call. vlen excludes the trailing zero
+SDB_API bool sdb_cursor_next(Sdb* s, SdbCursor *c, const char **key, const char **value, ut32 *vlen) {
+	ut32 klen, len, pos = c->pos;
+	const char *map = s->db.map;
+	if (!map) {
+		return s->db.pc? cursor_read (s, c, key, value, vlen): false;
+	}
+	if (pos >= c->end || c->end > s->db.size) {
+		return false;
+	}
+	if (c->end - pos < KVLSZ) {
+		return false;
+	}
+	klen = (ut8)map[pos];
+	len = (ut8)map[pos + 1] | ((ut8)map[pos + 2] << 8) | ((ut8)map[pos + 3] << 16);
+	pos += KVLSZ;
+	if (klen < 1 || len < 1 || c->end - pos < klen + len) {
+		return false;
+	}
+	/* both strings carry their own terminator on disk */
+	if (map[pos + klen - 1] || map[pos + klen + len - 1]) {
+		return false;
+	}
+	c->pos = pos + klen + len;
+	if (key) {
+		*key = map + pos;
+		if (cdb_sorted (&s->db) && !(*key = cdb_kat (&s->db, &c->kc, pos - KVLSZ))) {
+			return false;
+		}
+	}
+	if (value) {
+		*value = map + pos + klen;
+		/* decoded into the cursor, so parallel iterations do not share it */
+		if (cdb_compressed (&s->db) && !(*value = cdb_zvalue (&s->db, *value, len, &len, &c->zb))) {
+			return false;
+		}
+	}
+	if (vlen) {
+		*vlen = len - 1;
+	}
+	return true;
+}
+
+/* replaces the stub read by sdb_cursor_dupnext with a copy of its value */
+static bool cursor_dupvalue(Sdb *s, char **value, int *_vlen, ut32 len) {
+	const char *v = cdb_zvalue (&s->db, *value, len, &len, NULL);
+	char *dup = v? malloc (len + 10): NULL;
+	if (dup) {
+		memcpy (dup, v, len);
+		if (_vlen) {
+			*_vlen = len;
+		}
+	}
+	free (*value);
+	*value = dup;
+	return dup != NULL;
+}
+
+SDB_API bool sdb_cursor_dupnext(Sdb* s, SdbCursor *c, char *key, char **value, int *_vlen) {
+	ut32 vlen = 0, klen = 0, pos = c->pos;
 	if (value) {
 		*value = NULL;
 	}
 	if (_vlen) {
 		*_vlen = 0;
 	}
-	if (!cdb_getkvlen (&s->db, &klen, &vlen, s->pos)) {
+	if (pos >= c->end || !cdb_getkvlen (&s->db, &klen, &vlen, pos)) {
 		return false;
 	}
-	s->pos += 4;
 	if (klen < 1 || vlen < 1) {
 		return false;
 	}
+	pos += 4;
+	c->pos = pos + klen + vlen;
 	if (_vlen) {
 		*_vlen = vlen;
 	}
 	if (key) {
 		key[0] = 0;
-		if (klen > SDB_MIN_KEY && klen < SDB_MAX_KEY) {
-			if (getbytes (s, key, klen) == -1) {
-				return 0;
+		if (cdb_sorted (&s->db)) {
+			const char *k = cdb_kat (&s->db, &c->kc, pos - KVLSZ);
+			if (!k) {
+				return false;
+			}
+			strcpy (key, k);
+		} else if (klen > SDB_MIN_KEY && klen < SDB_MAX_KEY) {
+			if (!cdb_read (&s->db, key, klen, pos)) {
+				return false;
 			}
 			key[klen] = 0;
 		}
 	}
 	if (value) {
-		*value = 0;
 		if (vlen >= SDB_MIN_VALUE && vlen < SDB_MAX_VALUE) {
 			*value = malloc (vlen + 10);
 			if (!*value) {
 				return false;
 			}
-			if (getbytes (s, *value, vlen) == -1) {
+			if (!cdb_read (&s->db, *value, vlen, pos + klen)) {
 				free (*value);
 				*value = NULL;
 				return false;
 			}
 			(*value)[vlen] = 0;
+			if (cdb_compressed (&s->db) && !cursor_dupvalue (s, value, _vlen, vlen)) {
+				return false;
+			}
 		}
 	}
 	return true;
 }
 
+SDB_API void sdb_dump_begin(Sdb* s) {
+	sdb_cursor_begin (s, &s->dump);
+}
+
+SDB_API SdbKv *sdb_dump_next(Sdb* s) {
+	char *v = NULL;
+	char k[SDB_MAX_KEY] = {0};
+	int vl = 0;
+	if (!sdb_dump_dupnext (s, k, &v, &vl)) {
+		return NULL;
+	}
+	vl--;
+	free (sdbkv_key (&s->tmpkv));
+	s->tmpkv.base.key = strdup (k);
+	s->tmpkv.base.key_len = strlen (k);
+	free (sdbkv_value (&s->tmpkv));
+	s->tmpkv.base.value = v;
+	s->tmpkv.base.value_len = vl;
+	return &s->tmpkv;
+}
+
+SDB_API bool sdb_dump_hasnext(Sdb* s) {
+	return sdb_cursor_hasnext (s, &s->dump);
+}
+
+SDB_API bool sdb_stats(Sdb *s, ut32 *disk, ut32 *mem) {
+	if (!s) {
+		return false;
+	}
+	if (disk) {
+		ut32 count = 0;
+		if (s->fd != -1) {
+			SdbCursor c;
+			sdb_cursor_begin (s, &c);
+			while (sdb_cursor_hasnext (s, &c)) {
+				count ++;
+			}
+		}
+		*disk = count;
+	}
+	if (mem) {
+		*mem = s->ht->count;
+	}
+	return disk || mem;
+}
+
+// TODO: make it static? internal api?
+/* records whose ttl passed are skipped, the raw cursor still sees them */
+SDB_API bool sdb_dump_dupnext(Sdb* s, char *key, char **value, int *_vlen) {
+	for (;;) {
+		ut32 pos = s->dump.pos;
+		if (!sdb_cursor_dupnext (s, &s->dump, key, value, _vlen)) {
+			return false;
+		}
+		if (!sdb_disk_expired (s, pos)) {
+			return true;
+		}
+		if (value) {
+			R_FREE (*value);
+		}
+	}
+}
+
+static void timer_push(Sdb *s, const char *key, ut64 expire) {
+	ut32 i, up;
+	if (s->ntimers == s->mtimers) {
+		ut32 m = s->mtimers? s->mtimers * 2: 64;
+		SdbTimer *t = realloc (s->timers, m * sizeof (SdbTimer));
+		if (!t) {
+			return;
+		}
+		s->timers = t;
+		s->mtimers = m;
+	}
+	char *k = strdup (key);
+	if (!k) {
+		return;
+	}
+	for (i = s->ntimers++; i > 0; i = up) {
+		up = (i - 1) / 2;
+		if (s->timers[up].expire <= expire) {
+			break;
+		}
+		s->timers[i] = s->timers[up];
+	}
+	s->timers[i].expire = expire;
+	s->timers[i].key = k;
+}
+
+static void timer_pop(Sdb *s) {
+	ut32 i = 0, child;
+	SdbTimer last = s->timers[--s->ntimers];
+	while ((child = 2 * i + 1) < s->ntimers) {
+		if (child + 1 < s->ntimers && s->timers[child + 1].expire < s->timers[child].expire) {
+			child++;
+		}
+		if (last.expire <= s->timers[child].expire) {
+			break;
+		}
+		s->timers[i] = s->timers[child];
+		i = child;
+	}
+	s->timers[i] = last;
+}
+
+/* rebuild the heap from the table when renewed ttls left too many stale timers */
+static void timers_compact(Sdb *s) {
+	ut32 i, j;
+	sdb_timers_free (s);
+	for (i = 0; i < s->ht->size; i++) {
+		HtBucket *bt = &s->ht->table[i];
+		SdbKv *kv;
+		BUCKET_FOREACH (s->ht, bt, j, kv) {
+			if (kv->expire && sdbkv_value_len (kv) > 0) {
+				timer_push (s, sdbkv_key (kv), kv->expire);
+			}
+		}
+	}
+}
+
+/* drop up to max expired keys, all of them if max < 1. returns how many */
+SDB_API int sdb_expire_tick(Sdb* s, int max) {
+	int n = 0, work = 0;
+	ut64 now;
+	bool found;
+	if (!s || !s->ntimers) {
+		return 0;
+	}
+	now = sdb_now ();
+	while (s->ntimers && s->timers[0].expire < now && (max < 1 || work++ < max)) {
+		SdbTimer t = s->timers[0];
+		timer_pop (s);
+		SdbKv *kv = sdb_ht_find_kvp (s->ht, t.key, &found);
+		/* skip timers of keys that were renewed or removed since */
+		if (found && kv->expire == t.expire && sdbkv_value_len (kv) > 0) {
+			sdb_unset (s, t.key, 0);
+			n++;
+		}
+		free (t.key);
+	}
+	return n;
+}
+
 static inline ut64 parse_expire (ut64 e) {
 	const ut64 month = 30 * 24 * 60 * 60;
 	if (e > 0 && e < month) {
@@ -965,6 +1671,7 @@ static inline ut64 parse_expire (ut64 e) {
 SDB_API bool sdb_expire_set(Sdb* s, const char *key, ut64 expire, ut32 cas) {
 	char *buf;
 	ut32 pos, len;
+	int vlen;
 	SdbKv *kv;
 	bool found;
 	s->timestamped = true;
@@ -974,45 +1681,63 @@ SDB_API bool sdb_expire_set(Sdb* s, const char *key, ut64 expire, ut32 cas) {
 	}
 	kv = (SdbKv*)sdb_ht_find_kvp (s->ht, key, &found);
 	if (found && kv) {
-		if (*sdbkv_value (kv)) {
+		if (sdbkv_value_len (kv) > 0) {
 			if (!cas || cas == kv->cas) {
 				kv->expire = parse_expire (expire);
+				kv->clean = 0;
+				if (kv->expire) {
+					timer_push (s, key, kv->expire);
+					if (s->ntimers > 2 * s->ht->count + 64) {
+						timers_compact (s);
+					}
+					/* reclaim a few expired keys on every ttl set */
+					sdb_expire_tick (s, SDB_EXPIRE_BATCH);
+				}
 				return true;
 			}
 		}
 		return false;
 	}
-	if (s->fd == -1) {
+	/* the value is copied with its length, binary ones may start with zero */
+	SdbKey k = sdb_key (key);
+	if (!disk_find (s, &k, &pos, &len) || sdb_disk_expired (s, pos)) {
 		return false;
 	}
-	(void) cdb_findstart (&s->db);
-	if (!cdb_findnext (&s->db, sdb_hash (key), key, strlen (key) + 1)) {
+	pos += KVLSZ + disk_klen (s, k.len);
+	if (len < 2 || len >= INT32_MAX) {
 		return false;
 	}
-	pos = cdb_datapos (&s->db);
-	len = cdb_datalen (&s->db);
-	if (len < 1 || len >= INT32_MAX) {
+	if (!(buf = calloc (1, len + 1))) {
 		return false;
 	}
-	if (!(buf = calloc (1, len + 1))) {
+	if (!cdb_read (&s->db, buf, len, pos)) {
+		free (buf);
+		return false;
+	}
+	vlen = len;
+	if (cdb_compressed (&s->db) && !cursor_dupvalue (s, &buf, &vlen, len)) {
+		return false;
+	}
+	if (!sdb_set_internal (s, &k, buf, vlen - 1, SET_OWNED, cas)) {
 		return false;
 	}
-	cdb_read (&s->db, buf, len, pos);
-	buf[len] = 0;
-	sdb_set_owned (s, key, buf, cas);
 	return sdb_expire_set (s, key, expire, cas); // recursive
 }
 
 SDB_API ut64 sdb_expire_get(Sdb* s, const char *key, ut32 *cas) {
 	bool found = false;
 	SdbKv *kv = (SdbKv*)sdb_ht_find_kvp (s->ht, key, &found);
-	if (found && kv && *sdbkv_value (kv)) {
+	if (found && kv && sdbkv_value_len (kv) > 0) {
 		if (cas) {
 			*cas = kv->cas;
 		}
 		return kv->expire;
 	}
-	return 0LL;
+	if (found) {
+		return 0LL;
+	}
+	SdbKey k = sdb_key (key);
+	return disk_key_expire (s, &k);
 }
 
 SDB_API bool sdb_hook(Sdb* s, SdbHook cb, void* user) {
@@ -1094,6 +1819,43 @@ SDB_API void sdb_config(Sdb *s, int options) {
 	if (options & SDB_OPTION_FS) {
 		// have access to fs (handle '.' or not in query)
 	}
+	if (s->db.nomap != (!USE_MMAN || (options & SDB_OPTION_NOMAP))) {
+		s->db.nomap = !s->db.nomap;
+		if (s->fd != -1) {
+			cdb_init (&s->db, s->fd);
+		}
+	}
+	s->db.advice = CDB_ADVICE_NORMAL;
+	if (options & SDB_OPTION_RANDOM) {
+		s->db.advice |= CDB_ADVICE_RANDOM;
+	} else if (options & SDB_OPTION_SEQUENTIAL) {
+		s->db.advice |= CDB_ADVICE_SEQUENTIAL;
+	}
+	if (options & SDB_OPTION_WILLNEED) {
+		s->db.advice |= CDB_ADVICE_WILLNEED;
+	}
+	if (options & SDB_OPTION_HUGEPAGES) {
+		s->db.advice |= CDB_ADVICE_HUGEPAGE;
+	}
+	cdb_advise (&s->db, s->db.advice);
+}
+
+/* bytes used by the page cache of unmapped files, 0 for the default */
+SDB_API void sdb_page_cache(Sdb *s, ut64 size) {
+	ut64 npages = size / CDB_PAGE_SIZE;
+	if (size && !npages) {
+		npages = 1;
+	}
+	s->db.npages = npages > UT32_MAX? UT32_MAX: (ut32)npages;
+	if (s->db.nomap && s->fd != -1) {
+		cdb_init (&s->db, s->fd);
+	}
+}
+
+/* size of the buffer records are staged in on sync, 0 for the default.
+ * with SDB_OPTION_ASYNC it is the size of each buffer in flight */
+SDB_API void sdb_write_buffer(Sdb *s, ut32 size) {
+	s->wsize = size;
 }
 
 SDB_API int sdb_unlink(Sdb* s) {
@@ -63,11 +63,31 @@ extern char *strdup (const char *);
 #define SDB_NUM_BUFSZ 64
 
 #define SDB_OPTION_NONE 0
-#define SDB_OPTION_ALL 0xff
+#define SDB_OPTION_ALL 0xffff
 #define SDB_OPTION_SYNC    (1 << 0)
 #define SDB_OPTION_NOSTAMP (1 << 1)
 #define SDB_OPTION_FS      (1 << 2)
 #define SDB_OPTION_JOURNAL (1 << 3)
+#define SDB_OPTION_INDEX   (1 << 4)
+#define SDB_OPTION_CLUSTER (1 << 5) /* sync records in hash table order */
+/* access pattern of the mapped file, see cdb_advise() */
+#define SDB_OPTION_RANDOM     (1 << 6)
+#define SDB_OPTION_SEQUENTIAL (1 << 7)
+#define SDB_OPTION_WILLNEED   (1 << 8)
+#define SDB_OPTION_HUGEPAGES  (1 << 9)
+/* read the file with pread through a bounded page cache instead of
+ * mapping it, always on without USE_MMAN. see sdb_page_cache() */
+#define SDB_OPTION_NOMAP      (1 << 10)
+/* write the dump in large buffers from a background thread on sync */
+#define SDB_OPTION_ASYNC      (1 << 11)
+/* crc32c of every record and of the file on sync, see sdb_verify() */
+#define SDB_OPTION_CHECKSUM   (1 << 12)
+/* lookups check the record against its crc32c, bad ones are not found */
+#define SDB_OPTION_VERIFY     (1 << 13)
+/* values go to lz77 compressed blocks on sync, keys and tables stay raw */
+#define SDB_OPTION_COMPRESS   (1 << 14)
+/* values repeated in many records are stored once on sync */
+#define SDB_OPTION_DEDUP      (1 << 15)
 
 #define SDB_LIST_UNSORTED 0
 #define SDB_LIST_SORTED 1
@@ -76,6 +96,66 @@ extern char *strdup (const char *);
 #define SDB_KSZ 0xff
 #define SDB_VSZ 0xffffff
 
+// expired keys reclaimed on every sdb_expire_set
+#define SDB_EXPIRE_BATCH 8
+
+// marks a base64 encoded value in the journal
+#define SDB_JOURNAL_BIN '\x01'
+
+// slots in the disk lookup cache, must be a power of two
+#define SDB_CACHE_SIZE 4096
+
+#define SDB_BATCH_NODISK (1 << 0) // the keys are new, do not look them up in the file
+
+typedef struct sdb_kv_pair_t {
+	const char *key;
+	const char *value;
+} SdbKvPair;
+
+/* streaming writer for new files, see src/builder.c */
+#define SDB_BUILDER_DUP_KEEP  0 // write every record, lookups find the first
+#define SDB_BUILDER_DUP_FIRST 1 // drop later records of a key
+#define SDB_BUILDER_DUP_LAST  2 // the last record of a key wins
+
+typedef void (*SdbBuilderProgress)(void *user, ut64 records, ut64 bytes);
+
+typedef struct sdb_builder_t {
+	char *file;
+	char *tmp;
+	char *spath;
+	int fd;
+	int spill;
+	int dups;
+	struct cdb_make m;
+	ut64 records;
+	ut64 every;
+	SdbBuilderProgress progress;
+	void *user;
+} SdbBuilder;
+
+/* disk iteration state, lives on the caller's stack so iterations can nest */
+typedef struct sdb_cursor_t {
+	ut32 pos; // offset of the next record
+	ut32 end; // end of the records, start of the hash tables
+	char *buf; // last record when the file is not mapped, see sdb_cursor_end
+	ut32 bsize;
+	struct cdb_zbuf zb; // block of the last value of a compressed file
+	struct cdb_kcur kc; // keys of a sorted file
+} SdbCursor;
+
+/* pending expiration, the key is checked again when it fires */
+typedef struct sdb_timer_t {
+	ut64 expire;
+	char *key;
+} SdbTimer;
+
+/* disk record found for a key hash, klen counts the trailing zero */
+typedef struct sdb_cache_t {
+	ut32 hash;
+	ut32 pos;
+	ut32 klen;
+	ut32 dlen;
+} SdbCache;
 
 typedef struct sdb_t {
 	char *dir; // path+name
@@ -89,7 +169,7 @@ typedef struct sdb_t {
 	struct cdb_make m;
 	SdbHt *ht;
 	ut32 eod;
-	ut32 pos;
+	SdbCursor dump; // used by the sdb_dump_* api
 	int fdump;
 	char *ndump;
 	ut64 expire;
@@ -102,6 +182,26 @@ typedef struct sdb_t {
 	ut32 depth;
 	bool timestamped;
 	SdbMini mht;
+	SdbKv **order; // memory entries sorted by key
+	ut32 norder;
+	bool reorder; // order is stale, the memory table changed
+	ut64 mem; // bytes held by the memory table
+	ut64 mem_limit;
+	ut64 mem_floor; // bytes left after the last write back
+	ut32 hand; // CLOCK position in the memory table
+	ut64 evictions;
+	SdbTimer *timers; // min-heap by expire time
+	ut32 ntimers;
+	ut32 mtimers;
+	char *ttl; // expirations of the file being written
+	ut32 nttl;
+	ut32 mttl;
+	SdbCache *cache; // direct mapped, reset when the file is reopened
+	char *vbuf; // last disk value returned when the file is not mapped
+	ut32 vsize;
+	ut32 wsize; // bytes staged per write on sync, 0 for the default
+	char *zpath; // value blocks of the dump being written, see SDB_OPTION_COMPRESS
+	int zfd;
 } Sdb;
 
 typedef struct sdb_ns_t {
@@ -117,6 +217,8 @@ SDB_API int sdb_open(Sdb *s, const char *file);
 SDB_API void sdb_close(Sdb *s);
 
 SDB_API void sdb_config(Sdb *s, int options);
+SDB_API void sdb_page_cache(Sdb *s, ut64 size);
+SDB_API void sdb_write_buffer(Sdb *s, ut32 size);
 SDB_API bool sdb_free(Sdb* s);
 SDB_API void sdb_file(Sdb* s, const char *dir);
 SDB_API bool sdb_merge(Sdb* d, Sdb *s);
@@ -125,6 +227,11 @@ SDB_API void sdb_reset(Sdb* s);
 SDB_API void sdb_setup(Sdb* s, int options);
 SDB_API void sdb_drain(Sdb*, Sdb*);
 SDB_API bool sdb_stats(Sdb *s, ut32 *disk, ut32 *mem);
+/* memory budget in bytes, 0 disables it. clean entries are evicted first
+ * and dirty ones are synced to disk, databases without file drop any.
+ * over budget any write may evict or run a full sdb_sync, so pointers from
+ * sdb_const_get only last until the next write */
+SDB_API void sdb_memory_limit(Sdb *s, ut64 bytes);
 SDB_API bool sdb_dump_hasnext (Sdb* s);
 
 typedef int (*SdbForeachCallback)(void *user, const char *k, const char *v);
@@ -133,6 +240,26 @@ SdbList *sdb_foreach_list(Sdb* s, bool sorted);
 SdbList *sdb_foreach_list_filter(Sdb* s, SdbForeachCallback filter, bool sorted);
 SdbList *sdb_foreach_match(Sdb* s, const char *expr, bool sorted);
 
+/* parallel scans, the callback runs concurrently and must not modify the db.
+ * it may read it with sdb_const_get and friends: lookups leave the table
+ * and the disk lookup cache untouched while a scan runs, expired keys read
+ * as missing and are unset later. other threads must not write meanwhile.
+ * values of compressed files (SDB_OPTION_COMPRESS) are decoded into a block
+ * cache shared by the file, callbacks scanning them must not look keys up.
+ * fork returns the per-thread user pointer, join merges it back when done */
+typedef void *(*SdbForeachFork)(void *user);
+typedef void (*SdbForeachJoin)(void *user, void *tuser);
+SDB_API bool sdb_foreach_parallel(Sdb *s, SdbForeachCallback cb, void *user, int nthreads);
+SDB_API bool sdb_foreach_reduce(Sdb *s, SdbForeachCallback cb, SdbForeachFork fork, SdbForeachJoin join, void *user, int nthreads);
+
+/* sorted key index, see SDB_OPTION_INDEX */
+SDB_API bool sdb_index_write(Sdb *s);
+SDB_API bool sdb_index_has(Sdb *s);
+SDB_API bool sdb_index_range(Sdb *s, const char *from, const char *to, SdbForeachCallback cb, void *user);
+/* ordered walk over the keys in [from, to), NULL bounds are open. files
+ * without index are sorted on the fly. the callback must not modify the db */
+SDB_API bool sdb_range(Sdb *s, const char *from, const char *to, SdbForeachCallback cb, void *user);
+
 int sdb_query(Sdb* s, const char *cmd);
 int sdb_queryf(Sdb* s, const char *fmt, ...);
 int sdb_query_lines(Sdb *s, const char *cmd);
@@ -152,14 +279,34 @@ char *sdb_get(Sdb*, const char *key, ut32 *cas);
 // length of the value string.
 char *sdb_get_len(Sdb*, const char *key, int *vlen, ut32 *cas);
 
-// Gets a const pointer to the value associated with `key`
+// Gets a const pointer to the value associated with `key`, valid until the
+// next write to the db (see sdb_memory_limit)
 const char *sdb_const_get(Sdb*, const char *key, ut32 *cas);
 
 // Gets a const pointer to the value associated with `key` and returns in
 // `vlen` the length of the value string.
 const char *sdb_const_get_len(Sdb* s, const char *key, int *vlen, ut32 *cas);
 int sdb_set(Sdb*, const char *key, const char *data, ut32 cas);
+
+// Variants for callers that already know the key length, or keep an SdbKey
+// from sdb_key() around so it is not measured and hashed on every call.
+// The key must still end with a zero at klen, it is stored and passed to
+// the journal and hooks as a string.
+const char *sdb_const_get_keylen(Sdb* s, const char *key, ut32 klen, int *vlen, ut32 *cas);
+const char *sdb_const_get_key(Sdb* s, const SdbKey *key, int *vlen, ut32 *cas);
+int sdb_set_len(Sdb* s, const char *key, ut32 klen, const char *val, ut32 cas);
+int sdb_set_key(Sdb* s, const SdbKey *key, const char *val, ut32 cas);
+
+// Stores n pairs at once: the memory table is sized for all of them up
+// front, the journal is written once and the hooks are called once.
+int sdb_set_batch(Sdb* s, const SdbKvPair *pairs, size_t n, int flags);
 int sdb_set_owned(Sdb* s, const char *key, char *val, ut32 cas);
+
+// Binary safe variants, values carry their length and may contain zeroes.
+// The returned buffers are still zero terminated after `len` bytes.
+int sdb_set_bin(Sdb* s, const char *key, const ut8 *val, ut32 len, ut32 cas);
+const ut8 *sdb_const_get_bin(Sdb* s, const char *key, ut32 *len, ut32 *cas);
+ut8 *sdb_get_bin(Sdb* s, const char *key, ut32 *len, ut32 *cas);
 int sdb_concat(Sdb *s, const char *key, const char *value, ut32 cas);
 int sdb_uncat(Sdb *s, const char *key, const char *value, ut32 cas);
 int sdb_add(Sdb* s, const char *key, const char *val, ut32 cas);
@@ -176,6 +323,8 @@ ut64 sdb_num_inc(Sdb* s, const char *key, ut64 n, ut32 cas);
 ut64 sdb_num_dec(Sdb* s, const char *key, ut64 n, ut32 cas);
 int  sdb_num_min(Sdb* s, const char *key, ut64 v, ut32 cas);
 int  sdb_num_max(Sdb* s, const char *key, ut64 v, ut32 cas);
+SDB_API ut64 sdb_num_get_key(Sdb* s, const SdbKey *k, ut32 *cas);
+SDB_API int sdb_num_set_key(Sdb* s, const SdbKey *k, ut64 v, ut32 cas);
 
 /* ptr */
 int sdb_ptr_set(Sdb *db, const char *key, void *p, ut32 cas);
@@ -184,19 +333,55 @@ void* sdb_ptr_get(Sdb *db, const char *key, ut32 *cas);
 /* create db */
 SDB_API bool sdb_disk_create(Sdb* s);
 int sdb_disk_insert(Sdb* s, const char *key, const char *val);
+SDB_API int sdb_disk_insert_expire(Sdb* s, const char *key, const char *val, ut64 expire);
+SDB_API int sdb_disk_insert_bin(Sdb* s, const char *key, const ut8 *val, ut32 len, ut64 expire);
+SDB_API ut64 sdb_disk_expire(Sdb* s, ut32 pos);
+SDB_API bool sdb_disk_expired(Sdb* s, ut32 pos);
 SDB_API bool sdb_disk_finish(Sdb* s);
 SDB_API bool sdb_disk_unlink(Sdb* s);
 
+/* build a file without the memory table */
+SDB_API SdbBuilder *sdb_builder_new(const char *file, int dups);
+SDB_API bool sdb_builder_memory(SdbBuilder *b, ut64 bytes);
+SDB_API bool sdb_builder_buffer(SdbBuilder *b, char *buf, ut32 size);
+SDB_API bool sdb_builder_sorted(SdbBuilder *b, ut32 interval);
+SDB_API void sdb_builder_progress(SdbBuilder *b, SdbBuilderProgress cb, void *user, ut64 every);
+SDB_API bool sdb_builder_add(SdbBuilder *b, const char *key, const char *val);
+SDB_API bool sdb_builder_add_bin(SdbBuilder *b, const char *key, const ut8 *val, ut32 len);
+SDB_API bool sdb_builder_finish(SdbBuilder *b);
+SDB_API void sdb_builder_free(SdbBuilder *b);
+
+/* checks a file, see src/verify.c */
+typedef struct sdb_verify_t {
+	ut32 records;  // records walked
+	ut32 badrec;   // records out of bounds or with a wrong crc32c
+	ut32 badslot;  // hash table slots pointing to the wrong record
+	ut32 badtable; // tables out of the file
+	ut32 badblock; // value blocks that do not decompress
+	bool hascrc;   // records had a crc32c to check
+	bool hassum;   // the file had a checksum
+	bool badsum;
+} SdbVerify;
+
+SDB_API bool sdb_verify(Sdb *s, SdbVerify *v, int threads);
+
 /* iterate */
 SDB_API void sdb_dump_begin(Sdb* s);
 SDB_API SdbKv *sdb_dump_next(Sdb* s);
 SDB_API bool sdb_dump_dupnext(Sdb* s, char *key, char **value, int *_vlen);
+SDB_API void sdb_cursor_begin(Sdb* s, SdbCursor *c);
+SDB_API bool sdb_cursor_hasnext(Sdb* s, SdbCursor *c);
+SDB_API bool sdb_cursor_next(Sdb* s, SdbCursor *c, const char **key, const char **value, ut32 *vlen);
+SDB_API bool sdb_cursor_dupnext(Sdb* s, SdbCursor *c, char *key, char **value, int *_vlen);
+SDB_API void sdb_cursor_end(Sdb* s, SdbCursor *c);
 
 /* journaling */
 SDB_API bool sdb_journal_close(Sdb *s);
 SDB_API bool sdb_journal_open(Sdb *s);
 SDB_API int sdb_journal_load(Sdb *s);
 SDB_API bool sdb_journal_log(Sdb *s, const char *key, const char *val);
+SDB_API bool sdb_journal_log_bin(Sdb *s, const char *key, const ut8 *val, ut32 len);
+SDB_API bool sdb_journal_log_batch(Sdb *s, const SdbKvPair *pairs, size_t n);
 SDB_API bool sdb_journal_clear(Sdb *s);
 SDB_API bool sdb_journal_unlink(Sdb *s);
 
@@ -215,10 +400,16 @@ SDB_API int sdb_lock_wait(const char *s UNUSED);
 /* expiration */
 SDB_API bool sdb_expire_set(Sdb* s, const char *key, ut64 expire, ut32 cas);
 SDB_API ut64 sdb_expire_get(Sdb* s, const char *key, ut32 *cas);
+SDB_API int sdb_expire_tick(Sdb* s, int max);
 SDB_API ut64 sdb_now(void);
 SDB_API ut64 sdb_unow(void);
 SDB_API ut32 sdb_hash(const char *key);
+SDB_API ut32 sdb_crc32c(ut32 crc, const void *buf, ut64 len);
+SDB_API ut32 sdb_lz_compress(const ut8 *src, ut32 len, ut8 *dst, ut32 cap);
+SDB_API bool sdb_lz_decompress(const ut8 *src, ut32 len, ut8 *dst, ut32 cap, ut32 *out);
 SDB_API ut32 sdb_hash_len(const char *key, ut32 *len);
+SDB_API SdbKey sdb_key(const char *key);
+SDB_API SdbKey sdb_key_len(const char *key, ut32 len);
 SDB_API ut8 sdb_hash_byte(const char *s);
 
 /* json api */
@@ -1,10 +1,16 @@
-#include "sdbht.h"
+#include "sdb.h"
 
 void sdbkv_fini(SdbKv *kv) {
 	free (kv->base.key);
 	free (kv->base.value);
 }
 
+/* the value buffer of numbers holds SDB_NUM_BUFSZ bytes */
+void sdbkv_render(SdbKv *kv) {
+	sdb_itoa (kv->num, kv->base.value, kv->nbase);
+	kv->base.value_len = strlen (kv->base.value);
+}
+
 SDB_API SdbHt* sdb_ht_new() {
 	SdbHt *ht = ht_new ((DupValue)strdup, (HtKvFreeFunc)sdbkv_fini, (CalcSize)strlen);
 	ht->elem_size = sizeof (SdbKv);
@@ -16,7 +22,7 @@ static bool sdb_ht_internal_insert(SdbHt* ht, const char* key,
 	if (!ht || !key || !value) {
 		return false;
 	}
-	SdbKv kvp;
+	SdbKv kvp = {{0}};
 	kvp.base.key = strdup ((void *)key);
 	kvp.base.value = strdup ((void *)value);
 	kvp.base.key_len = strlen ((void *)kvp.base.key);
@@ -41,6 +47,22 @@ SDB_API SdbKv* sdb_ht_find_kvp(SdbHt* ht, const char* key, bool* found) {
 	return (SdbKv *)ht_find_kv (ht, key, found);
 }
 
+SDB_API SdbKv* sdb_ht_find_key(SdbHt* ht, const SdbKey *key, bool* found) {
+	return (SdbKv *)ht_find_kv_hash (ht, key->ptr, key->len, key->hash, found);
+}
+
+SDB_API bool sdb_ht_insert_key(SdbHt* ht, const SdbKey *key, SdbKv *kvp, bool update) {
+	return ht_insert_kv_hash (ht, (HtKv*)kvp, key->hash, update);
+}
+
+SDB_API bool sdb_ht_delete_key(SdbHt* ht, const SdbKey *key) {
+	return ht_delete_hash (ht, key->ptr, key->len, key->hash);
+}
+
+SDB_API void sdb_ht_reserve(SdbHt* ht, ut32 count) {
+	ht_reserve (ht, count);
+}
+
 SDB_API char* sdb_ht_find(SdbHt* ht, const char* key, bool* found) {
 	return (char *)ht_find (ht, key, found);
 }
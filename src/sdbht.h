@@ -8,9 +8,22 @@ typedef struct sdb_kv {
 	//sub of HtKv so we can cast safely
 	HtKv base;
 	ut32 cas;
+	ut8 ref;   // recently used, CLOCK second chance
+	ut8 clean; // same value as the disk, can be dropped
+	ut8 nbase; // the value is num in this base, see sdb_num_set()
 	ut64 expire;
+	ut64 num;
 } SdbKv;
 
+/** key with its length and sdb_hash, computed once by the caller **/
+typedef struct sdb_key_t {
+	const char *ptr;
+	ut32 len;
+	ut32 hash;
+} SdbKey;
+
+extern void sdbkv_render(SdbKv *kv);
+
 static inline char *sdbkv_key(const SdbKv *kv) {
 	return kv->base.key;
 }
@@ -48,5 +61,11 @@ SDB_API bool sdb_ht_delete(SdbHt* ht, const char* key);
 SDB_API char* sdb_ht_find(SdbHt* ht, const char* key, bool* found);
 // Find the KeyValuePair corresponding to the matching key.
 SDB_API SdbKv* sdb_ht_find_kvp(SdbHt* ht, const char* key, bool* found);
+// Same as above, without hashing the key again.
+SDB_API SdbKv* sdb_ht_find_key(SdbHt* ht, const SdbKey *key, bool* found);
+SDB_API bool sdb_ht_insert_key(SdbHt* ht, const SdbKey *key, SdbKv *kvp, bool update);
+SDB_API bool sdb_ht_delete_key(SdbHt* ht, const SdbKey *key);
+// Make room for count entries without growing on the way.
+SDB_API void sdb_ht_reserve(SdbHt* ht, ut32 count);
 
 #endif // __SDB_HT_H
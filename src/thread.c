@@ -0,0 +1,256 @@
+/* sdb - MIT - Copyright 2018 - pancake */
+
+#include "thread.h"
+
+#if USE_THREADS
+#if __SDB_WINDOWS__
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#endif
+
+typedef struct {
+	SdbThreadWorker fn;
+	void *user;
+	int idx;
+} SdbThreadJob;
+
+SDB_API int sdb_th_ncpu(void) {
+#if __SDB_WINDOWS__
+	SYSTEM_INFO si;
+	GetSystemInfo (&si);
+	return si.dwNumberOfProcessors > 0? (int)si.dwNumberOfProcessors: 1;
+#elif defined(_SC_NPROCESSORS_ONLN)
+	long n = sysconf (_SC_NPROCESSORS_ONLN);
+	return n > 0? (int)n: 1;
+#else
+	return 1;
+#endif
+}
+
+#if USE_THREADS
+#if __SDB_WINDOWS__
+static DWORD WINAPI th_main(LPVOID arg) {
+	SdbThreadJob *job = arg;
+	job->fn (job->user, job->idx);
+	return 0;
+}
+#else
+static void *th_main(void *arg) {
+	SdbThreadJob *job = arg;
+	job->fn (job->user, job->idx);
+	return NULL;
+}
+#endif
+#endif
+
+// index 0 runs in the calling thread, the call returns when all are done
+SDB_API bool sdb_th_run(int n, SdbThreadWorker fn, void *user) {
+	int i;
+	if (!fn || n < 1 || n > SDB_TH_MAX) {
+		return false;
+	}
+#if USE_THREADS
+	SdbThreadJob *jobs = calloc (n, sizeof (SdbThreadJob));
+	bool *started = calloc (n, sizeof (bool));
+#if __SDB_WINDOWS__
+	HANDLE *th = calloc (n, sizeof (HANDLE));
+#else
+	pthread_t *th = calloc (n, sizeof (pthread_t));
+#endif
+	if (!jobs || !started || !th) {
+		free (jobs);
+		free (started);
+		free (th);
+		goto serial;
+	}
+	for (i = 1; i < n; i++) {
+		jobs[i].fn = fn;
+		jobs[i].user = user;
+		jobs[i].idx = i;
+#if __SDB_WINDOWS__
+		th[i] = CreateThread (NULL, 0, th_main, &jobs[i], 0, NULL);
+		started[i] = th[i] != NULL;
+#else
+		started[i] = !pthread_create (&th[i], NULL, th_main, &jobs[i]);
+#endif
+	}
+	fn (user, 0);
+	for (i = 1; i < n; i++) {
+		if (!started[i]) {
+			// could not spawn it, do the work here
+			fn (user, i);
+			continue;
+		}
+#if __SDB_WINDOWS__
+		WaitForSingleObject (th[i], INFINITE);
+		CloseHandle (th[i]);
+#else
+		pthread_join (th[i], NULL);
+#endif
+	}
+	free (jobs);
+	free (started);
+	free (th);
+	return true;
+serial:
+#endif
+	for (i = 0; i < n; i++) {
+		fn (user, i);
+	}
+	return true;
+}
+
+struct sdb_thread_t {
+	SdbThreadJob job;
+#if USE_THREADS
+#if __SDB_WINDOWS__
+	HANDLE th;
+#else
+	pthread_t th;
+#endif
+#endif
+};
+
+SDB_API SdbThread *sdb_th_new(SdbThreadWorker fn, void *user) {
+#if USE_THREADS
+	SdbThread *th = R_NEW0 (SdbThread);
+	if (!fn || !th) {
+		free (th);
+		return NULL;
+	}
+	th->job.fn = fn;
+	th->job.user = user;
+#if __SDB_WINDOWS__
+	th->th = CreateThread (NULL, 0, th_main, &th->job, 0, NULL);
+	if (!th->th) {
+#else
+	if (pthread_create (&th->th, NULL, th_main, &th->job)) {
+#endif
+		free (th);
+		return NULL;
+	}
+	return th;
+#else
+	return NULL;
+#endif
+}
+
+SDB_API void sdb_th_join(SdbThread *th) {
+	if (!th) {
+		return;
+	}
+#if USE_THREADS
+#if __SDB_WINDOWS__
+	WaitForSingleObject (th->th, INFINITE);
+	CloseHandle (th->th);
+#else
+	pthread_join (th->th, NULL);
+#endif
+#endif
+	free (th);
+}
+
+struct sdb_queue_t {
+	void **items;
+	int size;
+	int head;
+	int count;
+#if USE_THREADS
+#if __SDB_WINDOWS__
+	CRITICAL_SECTION lock;
+	CONDITION_VARIABLE cond;
+#else
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+#endif
+#endif
+};
+
+#if USE_THREADS
+#if __SDB_WINDOWS__
+#define q_lock(q) EnterCriticalSection (&(q)->lock)
+#define q_unlock(q) LeaveCriticalSection (&(q)->lock)
+#define q_wait(q) SleepConditionVariableCS (&(q)->cond, &(q)->lock, INFINITE)
+#define q_wake(q) WakeAllConditionVariable (&(q)->cond)
+#else
+#define q_lock(q) pthread_mutex_lock (&(q)->lock)
+#define q_unlock(q) pthread_mutex_unlock (&(q)->lock)
+#define q_wait(q) pthread_cond_wait (&(q)->cond, &(q)->lock)
+#define q_wake(q) pthread_cond_broadcast (&(q)->cond)
+#endif
+#else
+#define q_lock(q)
+#define q_unlock(q)
+#define q_wait(q)
+#define q_wake(q)
+#endif
+
+// without threads nobody else could ever fill or drain it
+SDB_API SdbQueue *sdb_queue_new(int size) {
+	SdbQueue *q;
+	if (!USE_THREADS || size < 1) {
+		return NULL;
+	}
+	q = R_NEW0 (SdbQueue);
+	if (!q) {
+		return NULL;
+	}
+	q->items = calloc (size, sizeof (void *));
+	if (!q->items) {
+		free (q);
+		return NULL;
+	}
+	q->size = size;
+#if USE_THREADS
+#if __SDB_WINDOWS__
+	InitializeCriticalSection (&q->lock);
+	InitializeConditionVariable (&q->cond);
+#else
+	pthread_mutex_init (&q->lock, NULL);
+	pthread_cond_init (&q->cond, NULL);
+#endif
+#endif
+	return q;
+}
+
+SDB_API void sdb_queue_free(SdbQueue *q) {
+	if (!q) {
+		return;
+	}
+#if USE_THREADS
+#if __SDB_WINDOWS__
+	DeleteCriticalSection (&q->lock);
+#else
+	pthread_mutex_destroy (&q->lock);
+	pthread_cond_destroy (&q->cond);
+#endif
+#endif
+	free (q->items);
+	free (q);
+}
+
+SDB_API void sdb_queue_push(SdbQueue *q, void *p) {
+	q_lock (q);
+	while (q->count == q->size) {
+		q_wait (q);
+	}
+	q->items[(q->head + q->count++) % q->size] = p;
+	q_wake (q);
+	q_unlock (q);
+}
+
+SDB_API void *sdb_queue_pop(SdbQueue *q) {
+	void *p;
+	q_lock (q);
+	while (!q->count) {
+		q_wait (q);
+	}
+	p = q->items[q->head];
+	q->head = (q->head + 1) % q->size;
+	q->count--;
+	q_wake (q);
+	q_unlock (q);
+	return p;
+}
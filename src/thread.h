@@ -0,0 +1,36 @@
+#ifndef SDB_THREAD_H
+#define SDB_THREAD_H
+
+#include "types.h"
+
+// most workers sdb_th_run accepts
+#define SDB_TH_MAX 256
+
+/* flags shared between workers, like a stop request */
+#if defined(__GNUC__) || defined(__clang__)
+#define sdb_th_load(x) __atomic_load_n (&(x), __ATOMIC_RELAXED)
+#define sdb_th_store(x, v) __atomic_store_n (&(x), (v), __ATOMIC_RELAXED)
+#else
+#define sdb_th_load(x) (*(volatile int *)&(x))
+#define sdb_th_store(x, v) (*(volatile int *)&(x) = (v))
+#endif
+
+/* runs a worker once per index, each index in its own thread */
+typedef void (*SdbThreadWorker)(void *user, int idx);
+
+SDB_API int sdb_th_ncpu(void);
+SDB_API bool sdb_th_run(int n, SdbThreadWorker fn, void *user);
+
+/* a long running thread, fn gets index 0. NULL without thread support */
+typedef struct sdb_thread_t SdbThread;
+SDB_API SdbThread *sdb_th_new(SdbThreadWorker fn, void *user);
+SDB_API void sdb_th_join(SdbThread *th);
+
+/* bounded fifo of pointers, push waits while full and pop while empty */
+typedef struct sdb_queue_t SdbQueue;
+SDB_API SdbQueue *sdb_queue_new(int size);
+SDB_API void sdb_queue_free(SdbQueue *q);
+SDB_API void sdb_queue_push(SdbQueue *q, void *p);
+SDB_API void *sdb_queue_pop(SdbQueue *q);
+
+#endif
@@ -54,6 +54,16 @@
 #define USE_MMAN HAVE_MMAN
 #endif
 
+#if __EMSCRIPTEN__
+#define HAVE_THREADS 0
+#else
+#define HAVE_THREADS 1
+#endif
+
+#ifndef USE_THREADS
+#define USE_THREADS HAVE_THREADS
+#endif
+
 #include <unistd.h>
 
 #ifndef UNUSED
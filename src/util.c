@@ -89,6 +89,20 @@ SDB_API ut32 sdb_hash(const char *s) {
 	return sdb_hash_len (s, NULL);
 }
 
+SDB_API SdbKey sdb_key(const char *s) {
+	SdbKey k = { s, 0, 0 };
+	if (s) {
+		k.hash = sdb_hash_len (s, &k.len);
+	}
+	return k;
+}
+
+/* len must be strlen (s), only the hash is computed */
+SDB_API SdbKey sdb_key_len(const char *s, ut32 len) {
+	SdbKey k = { s, len, sdb_hash (s) };
+	return k;
+}
+
 SDB_API ut8 sdb_hash_byte(const char *s) {
 	const ut32 hash = sdb_hash_len (s, NULL);
 	const ut8 *h = (const ut8*)&hash;
@@ -273,30 +287,52 @@ SDB_API const char *sdb_const_anext(const char *str) {
 	return p ? p + 1 : NULL;
 }
 
-SDB_API ut64 sdb_now () {
 #if USE_MONOTONIC_CLOCK
+#ifdef CLOCK_MONOTONIC_COARSE
+#define SDB_CLOCK CLOCK_MONOTONIC_COARSE
+#else
+#define SDB_CLOCK CLOCK_MONOTONIC
+#endif
+
+static inline ut64 clock_us(clockid_t id) {
 	struct timespec ts;
-	if (!clock_gettime (CLOCK_MONOTONIC, &ts)) {
-		return ts.tv_sec;
+	if (clock_gettime (id, &ts)) {
+		return 0LL;
 	}
+	return (ut64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* the monotonic clock is anchored to the wall clock once, so the results
+ * are still epoch based but later ntp steps do not move the expirations */
+static ut64 clock_now_us(void) {
+	static ut64 base = 0LL;
+	ut64 now = clock_us (SDB_CLOCK);
+	if (!base) {
+		base = clock_us (CLOCK_REALTIME) - now;
+	}
+	return now + base;
+}
+#endif
+
+SDB_API ut64 sdb_now () {
+#if USE_MONOTONIC_CLOCK
+	return clock_now_us () / 1000000;
 #else
 	struct timeval now;
 	if (!gettimeofday (&now, NULL)) {
 		return now.tv_sec;
 	}
-#endif
 	return 0LL;
+#endif
 }
 
 SDB_API ut64 sdb_unow () {
 	ut64 x = 0LL;
 #if USE_MONOTONIC_CLOCK
-	struct timespec ts;
-	if (!clock_gettime (CLOCK_MONOTONIC, &ts)) {
-		x = ts.tv_sec;
-		x <<= 32;
-		x += ts.tv_nsec / 1000;
-	}
+	ut64 us = clock_now_us ();
+	x = us / 1000000;
+	x <<= 32;
+	x += us % 1000000;
 #else
         struct timeval now;
         if (!gettimeofday (&now, NULL)) {
@@ -0,0 +1,203 @@
+/* sdb - MIT - Copyright 2018 - pancake */
+
+#include "sdb.h"
+#include "thread.h"
+
+/* checks the layout of the file and its checksums without trusting it.
+ * records are checked in chunks of the crc section, hash tables and value
+ * blocks one by one, all spread over the threads */
+
+#define VERIFY_MAX 64
+
+typedef struct {
+	struct cdb *db;
+	char *crc;
+	ut32 ncrc;
+	ut32 sumpos; // 0 if the file has no checksum
+	ut32 sum;
+	ut32 tpos[256]; // UT32_MAX for tables out of the file
+	ut32 tend[256];
+	int n;
+	SdbVerify *part;
+} VerifyCtx;
+
+/* the sum was taken with its own 4 bytes zeroed */
+static bool verify_sum(struct cdb *db, ut32 sumpos, ut32 sum) {
+	ut32 crc = 0;
+	if (!cdb_crc (db, 0, sumpos, &crc)) {
+		return false;
+	}
+	crc = sdb_crc32c (crc, "\0\0\0\0", 4);
+	if (!cdb_crc (db, sumpos + 4, db->size - sumpos - 4, &crc)) {
+		return false;
+	}
+	return crc == sum;
+}
+
+/* length of the record at pos, 0 if it does not fit before the sections */
+static ut32 verify_record(struct cdb *db, ut32 pos) {
+	ut32 klen, vlen;
+	if (pos < 1024 || pos >= db->eod || db->eod - pos < KVLSZ) {
+		return 0;
+	}
+	if (!cdb_getkvlen (db, &klen, &vlen, pos) || klen < 1 || vlen < 1) {
+		return 0;
+	}
+	return (KVLSZ + klen + vlen <= db->eod - pos)? KVLSZ + klen + vlen: 0;
+}
+
+/* without a crc section the records can only be walked in order */
+static void verify_walk(VerifyCtx *ctx, SdbVerify *v) {
+	struct cdb *db = ctx->db;
+	ut32 len, pos = 1024;
+	while (pos < db->eod) {
+		if (!(len = verify_record (db, pos))) {
+			v->badrec++;
+			break;
+		}
+		v->records++;
+		pos += len;
+	}
+}
+
+/* entries [from, to) of the crc section. each record has to end where
+ * the next one starts, the last one at the end of the data */
+static void verify_crcs(VerifyCtx *ctx, SdbVerify *v, ut32 from, ut32 to) {
+	struct cdb *db = ctx->db;
+	ut32 i, pos, want, next, len, crc;
+	for (i = from; i < to; i++) {
+		ut32_unpack (ctx->crc + i * 8, &pos);
+		ut32_unpack (ctx->crc + i * 8 + 4, &want);
+		v->records++;
+		if (i + 1 < ctx->ncrc) {
+			ut32_unpack (ctx->crc + (i + 1) * 8, &next);
+		} else {
+			next = db->eod;
+		}
+		len = verify_record (db, pos);
+		crc = 0;
+		if (!len || pos + len != next || !cdb_crc (db, pos, len, &crc) || crc != want) {
+			v->badrec++;
+		}
+	}
+}
+
+static void verify_table(VerifyCtx *ctx, SdbVerify *v, int t) {
+	struct cdb *db = ctx->db;
+	ut32 i, h, p, len, klen, vlen, hpos = ctx->tpos[t];
+	char slot[8], key[256];
+	ut32 slots = (ctx->tend[t] - hpos) / 8;
+	for (i = 0; i < slots; i++) {
+		if (!cdb_read (db, slot, 8, hpos + i * 8)) {
+			v->badslot++;
+			continue;
+		}
+		ut32_unpack (slot, &h);
+		ut32_unpack (slot + 4, &p);
+		if (!p) {
+			continue;
+		}
+		len = verify_record (db, p);
+		if (!len || (h & 0xff) != (ut32)t || !cdb_getkvlen (db, &klen, &vlen, p)
+				|| !cdb_read (db, key, klen, p + KVLSZ) || key[klen - 1]
+				|| sdb_hash (key) != h) {
+			v->badslot++;
+		}
+	}
+}
+
+static void verify_worker(void *user, int idx) {
+	VerifyCtx *ctx = user;
+	SdbVerify *v = &ctx->part[idx];
+	struct cdb_zbuf zb = { NULL, 0, UT32_MAX, 0 };
+	ut32 i;
+	int t;
+	if (!idx && ctx->sumpos) {
+		v->badsum = !verify_sum (ctx->db, ctx->sumpos, ctx->sum);
+	}
+	if (ctx->crc) {
+		ut64 chunk = ((ut64)ctx->ncrc + ctx->n - 1) / ctx->n;
+		ut64 from = chunk * idx, to = from + chunk;
+		if (from < ctx->ncrc) {
+			verify_crcs (ctx, v, (ut32)from, (ut32)R_MIN (to, ctx->ncrc));
+		}
+	} else if (!idx) {
+		verify_walk (ctx, v);
+	}
+	for (t = idx; t < 256; t += ctx->n) {
+		if (ctx->tpos[t] != UT32_MAX) {
+			verify_table (ctx, v, t);
+		}
+	}
+	for (i = idx; i < ctx->db->nzblocks; i += ctx->n) {
+		if (!cdb_zblock (ctx->db, i, &zb)) {
+			v->badblock++;
+		}
+	}
+	cdb_zfree (&zb);
+}
+
+/* true if nothing is wrong with the file s was opened from. v gets the
+ * details, threads is only a hint and 0 picks one per cpu */
+SDB_API bool sdb_verify(Sdb *s, SdbVerify *v, int threads) {
+	VerifyCtx ctx = {0};
+	struct cdb *db = &s->db;
+	ut32 i, len;
+	char buf[4];
+	int n;
+	memset (v, 0, sizeof (SdbVerify));
+	if (s->fd == -1 || !cdb_loaded (db) || db->size < 1024) {
+		v->badtable = 256;
+		return false;
+	}
+	ctx.db = db;
+	/* tables must follow each other up to the end of the file */
+	for (i = 0; i < 256; i++) {
+		ut32 pos, next;
+		if (!cdb_read (db, buf, 4, i * 4)) {
+			pos = UT32_MAX;
+		} else {
+			ut32_unpack (buf, &pos);
+		}
+		next = db->size;
+		if (i < 255 && cdb_read (db, buf, 4, (i + 1) * 4)) {
+			ut32_unpack (buf, &next);
+		}
+		if (pos < db->eod || pos > next || next > db->size || (next - pos) % 8) {
+			v->badtable++;
+			ctx.tpos[i] = UT32_MAX;
+		} else {
+			ctx.tpos[i] = pos;
+			ctx.tend[i] = next;
+		}
+	}
+	for (i = 0; i < db->nsect; i++) {
+		if (db->sect[i].type == CDB_SECT_SUM && db->sect[i].len == 4) {
+			ctx.sumpos = db->sect[i].pos;
+			ut32_unpack ((char *)cdb_section (db, CDB_SECT_SUM, NULL), &ctx.sum);
+		}
+	}
+	ctx.crc = (char *)cdb_section (db, CDB_SECT_CRC, &len);
+	ctx.ncrc = ctx.crc? len / 8: 0;
+	n = threads > 0? threads: sdb_th_ncpu ();
+	if (!db->map) {
+		n = 1; // the page cache is not shared
+	}
+	ctx.n = R_MAX (1, R_MIN (n, VERIFY_MAX));
+	ctx.part = calloc (ctx.n, sizeof (SdbVerify));
+	if (!ctx.part) {
+		return false;
+	}
+	sdb_th_run (ctx.n, verify_worker, &ctx);
+	for (n = 0; n < ctx.n; n++) {
+		v->records += ctx.part[n].records;
+		v->badrec += ctx.part[n].badrec;
+		v->badslot += ctx.part[n].badslot;
+		v->badblock += ctx.part[n].badblock;
+		v->badsum |= ctx.part[n].badsum;
+	}
+	free (ctx.part);
+	v->hascrc = ctx.crc != NULL;
+	v->hassum = ctx.sumpos != 0;
+	return !v->badrec && !v->badslot && !v->badtable && !v->badblock && !v->badsum;
+}
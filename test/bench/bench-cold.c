@@ -0,0 +1,80 @@
+#include <sdb.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "prof.c"
+
+/* cold cache lookups: the file is dropped from the page cache before
+ * every lookup, readahead is off, and the pages each lookup brought in
+ * are counted with mincore */
+
+#define DBFILE "bench-cold.sdb"
+#define ROUNDS 1000
+
+static void drop_cache(Sdb *db) {
+	madvise (db->db.map, db->db.size, MADV_DONTNEED);
+	posix_fadvise (db->fd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+static int resident(Sdb *db) {
+	long psz = sysconf (_SC_PAGESIZE);
+	int i, n = 0, pages = (db->db.size + psz - 1) / psz;
+	unsigned char *vec = malloc (pages);
+	if (vec && !mincore (db->db.map, db->db.size, vec)) {
+		for (i = 0; i < pages; i++) {
+			n += vec[i] & 1;
+		}
+	}
+	free (vec);
+	return n;
+}
+
+static void docold(int count, int options, const char *layout) {
+	char rkey[128];
+	RProfile p;
+	double t = 0;
+	int i, pages = 0;
+	unlink (DBFILE);
+	Sdb *db = sdb_new (NULL, DBFILE, 0);
+	sdb_config (db, options);
+	for (i = 0; i < count; i++) {
+		sprintf (rkey, "key.%d", i);
+		sdb_set (db, rkey, "some value long enough to fill a few pages", 0);
+	}
+	sdb_sync (db);
+	sdb_free (db);
+	db = sdb_new (NULL, DBFILE, 0);
+	sdb_config (db, SDB_OPTION_RANDOM);
+	srand (count);
+	for (i = 0; i < ROUNDS; i++) {
+		sprintf (rkey, "key.%d", rand () % count);
+		drop_cache (db);
+		r_prof_start (&p);
+		sdb_const_get (db, rkey, NULL);
+		r_prof_end (&p);
+		t += p.result;
+		pages += resident (db);
+	}
+	printf (__FILE__" %s %d %lf %.2f pages/lookup\n", layout,
+		count, t / ROUNDS, (double)pages / ROUNDS);
+	/* every key of one hash table, the records a table page points to */
+	drop_cache (db);
+	r_prof_start (&p);
+	for (i = 0; i < count; i++) {
+		sprintf (rkey, "key.%d", i);
+		if (!(sdb_hash (rkey) & 0xff)) {
+			sdb_const_get (db, rkey, NULL);
+		}
+	}
+	r_prof_end (&p);
+	printf (__FILE__" %s %d %lf %d pages/table\n", layout,
+		count, p.result, resident (db));
+	sdb_free (db);
+}
+
+int main(int argc, char **argv) {
+	int count = argc > 1? atoi (argv[1]): 1000000;
+	docold (count, 0, "classic");
+	docold (count, SDB_OPTION_CLUSTER, "cluster");
+	unlink (DBFILE);
+	return 0;
+}
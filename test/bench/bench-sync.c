@@ -3,12 +3,13 @@
 
 #define DBFILE "bench-sync.sdb"
 
-void dosync (int count) {
+void dosync (int count, int options, const char *mode) {
 	char rkey[128];
 	RProfile p;
 	int i;
 	unlink (DBFILE);
 	Sdb *db = sdb_new (NULL, DBFILE, 0);
+	sdb_config (db, options);
 	for (i=0; i<count; i++) {
 		sprintf (rkey, "%d", i);
 		sdb_set (db, rkey, rkey, 0);
@@ -17,18 +18,18 @@ void dosync (int count) {
 	sdb_sync (db);
 	r_prof_end (&p);
 	sdb_free (db);
-	printf (__FILE__" %lf %d\n", p.result, i);
+	printf (__FILE__" %s %lf %d\n", mode, p.result, i);
 }
 
 int main(int argc, char **argv) {
-	dosync (100);
-	dosync (1000);
-	dosync (10000);
-	dosync (100000);
-	dosync (1000000);
+	int n;
+	for (n = 100; n <= 1000000; n *= 10) {
+		dosync (n, 0, "write");
+		dosync (n, SDB_OPTION_ASYNC, "async");
+	}
 #if 0
-	dosync (10000000);
-	dosync (100000000);
+	dosync (10000000, 0, "write");
+	dosync (100000000, 0, "write");
 #endif
 	unlink (DBFILE);
 	return 0;
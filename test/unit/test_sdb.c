@@ -1,6 +1,8 @@
 #include "minunit.h"
 #include <sdb.h>
 #include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
 
 static int foreach_delete_cb(void *user, const char *key, const char *val) {
 	if (strcmp (key, "bar")) {
@@ -180,6 +182,1263 @@ bool test_sdb_foreach_filter(void) {
 	mu_end;
 }
 
+static int foreach_count_cb(void *user, const char *key, const char *val) {
+	(*(int *)user)++;
+	return 1;
+}
+
+static int foreach_nested_cb(void *user, const char *key, const char *val) {
+	void **u = user;
+	sdb_foreach (u[0], foreach_count_cb, u[1]);
+	return 1;
+}
+
+bool test_sdb_foreach_nested(void) {
+	const char *dbname = ".nested";
+	int count = 0;
+	unlink (dbname);
+	Sdb *db = sdb_new (NULL, dbname, false);
+	sdb_set (db, "foo", "bar", 0);
+	sdb_set (db, "bar", "cow", 0);
+	sdb_set (db, "low", "bar", 0);
+	sdb_sync (db);
+	void *u[2] = { db, &count };
+	sdb_foreach (db, foreach_nested_cb, u);
+	mu_assert_eq (count, 9, "nested foreach must visit every pair");
+	sdb_free (db);
+	unlink (dbname);
+	mu_end;
+}
+
+bool test_sdb_cursor(void) {
+	const char *dbname = ".cursor";
+	char k[SDB_MAX_KEY], *v;
+	SdbCursor a, b;
+	int n = 0;
+	unlink (dbname);
+	Sdb *db = sdb_new (NULL, dbname, false);
+	sdb_set (db, "foo", "bar", 0);
+	sdb_set (db, "bar", "cow", 0);
+	sdb_sync (db);
+	sdb_cursor_begin (db, &a);
+	while (sdb_cursor_dupnext (db, &a, k, &v, NULL)) {
+		sdb_cursor_begin (db, &b);
+		while (sdb_cursor_hasnext (db, &b)) {
+			n++;
+		}
+		mu_assert_streq (v, sdb_const_get (db, k, NULL), "cursor value");
+		free (v);
+	}
+	mu_assert_eq (n, 4, "cursors must be independent");
+	sdb_free (db);
+	unlink (dbname);
+	mu_end;
+}
+
+bool test_sdb_cursor_next(void) {
+	const char *dbname = ".cursornext";
+	const char *k, *v;
+	ut32 vlen;
+	SdbCursor c;
+	int n = 0;
+	unlink (dbname);
+	Sdb *db = sdb_new (NULL, dbname, false);
+	sdb_set (db, "foo", "bar", 0);
+	sdb_set (db, "long", "value", 0);
+	sdb_sync (db);
+	sdb_cursor_begin (db, &c);
+	while (sdb_cursor_next (db, &c, &k, &v, &vlen)) {
+		if (db->db.map) {
+			mu_assert ("value points into the map", v == sdb_const_get (db, k, NULL));
+		} else {
+			mu_assert_streq (v, sdb_const_get (db, k, NULL), "value read from disk");
+		}
+		mu_assert_eq (vlen, strlen (v), "value length");
+		n++;
+	}
+	mu_assert_eq (n, 2, "all records visited");
+	sdb_free (db);
+	unlink (dbname);
+	mu_end;
+}
+
+bool test_sdb_set_twice(void) {
+	const char *dbname = ".settwice";
+	unlink (dbname);
+	Sdb *db = sdb_new (NULL, dbname, false);
+	sdb_set (db, "foo", "bar", 0);
+	sdb_sync (db);
+	sdb_set (db, "baz", "1", 0);
+	sdb_set (db, "baz", "2", 0);
+	mu_assert_streq (sdb_const_get (db, "baz", NULL), "2", "value must survive an update");
+	mu_assert ("disk key exists", sdb_exists (db, "foo"));
+	sdb_unset (db, "baz", 0);
+	mu_assert ("unset key", !sdb_exists (db, "baz"));
+	sdb_free (db);
+	unlink (dbname);
+	mu_end;
+}
+
+static void *parallel_fork_cb(void *user) {
+	return calloc (1, sizeof (int));
+}
+
+static void parallel_join_cb(void *user, void *tuser) {
+	*(int *)user += *(int *)tuser;
+	free (tuser);
+}
+
+static int parallel_sum_cb(void *user, const char *k, const char *v) {
+	*(int *)user += (int)sdb_atoi (v);
+	return 1;
+}
+
+static Sdb *parallel_db;
+
+// reads the db back from every thread, the disk lookup cache is shared
+static int parallel_get_cb(void *user, const char *k, const char *v) {
+	const char *w = sdb_const_get (parallel_db, k, NULL);
+	*(int *)user += (w && !strcmp (v, w))? 1: 0;
+	return 1;
+}
+
+bool test_sdb_foreach_parallel(void) {
+	const char *dbname = ".parallel";
+	char key[32];
+	int i, sum = 0, expect = 0;
+	unlink (dbname);
+	Sdb *db = sdb_new (NULL, dbname, false);
+	for (i = 0; i < 1000; i++) {
+		snprintf (key, sizeof (key), "key%d", i);
+		sdb_num_set (db, key, i, 0);
+		expect += i;
+	}
+	sdb_sync (db);
+	// memory entries shadow the disk ones
+	sdb_num_set (db, "key1", 1001, 0);
+	sdb_unset (db, "key2", 0);
+	sdb_num_set (db, "new", 7, 0);
+	expect += 1000 - 2 + 7;
+	sdb_foreach_reduce (db, parallel_sum_cb, parallel_fork_cb, parallel_join_cb, &sum, 4);
+	mu_assert_eq (sum, expect, "every key visited once");
+	sum = 0;
+	sdb_foreach_reduce (db, parallel_sum_cb, parallel_fork_cb, parallel_join_cb, &sum, 1);
+	mu_assert_eq (sum, expect, "single thread");
+	sum = 0;
+	mu_assert ("more threads than allowed", sdb_foreach_reduce (db, parallel_sum_cb, parallel_fork_cb, parallel_join_cb, &sum, 1000));
+	mu_assert_eq (sum, expect, "clamped thread count");
+	sum = 0;
+	parallel_db = db;
+	sdb_foreach_reduce (db, parallel_get_cb, parallel_fork_cb, parallel_join_cb, &sum, 4);
+	mu_assert_eq (sum, 1000, "lookups from the callback");
+	sdb_free (db);
+	unlink (dbname);
+	mu_end;
+}
+
+// lookups from a scan leave the table alone, even of expired keys
+static int parallel_gone_cb(void *user, const char *k, const char *v) {
+	sdb_const_get (parallel_db, k, NULL);
+	*(int *)user += sdb_const_get (parallel_db, "gone", NULL)? 0: 1;
+	return 1;
+}
+
+bool test_sdb_foreach_parallel_readonly(void) {
+	char key[32];
+	int i, sum = 0;
+	Sdb *db = sdb_new0 ();
+	for (i = 0; i < 100; i++) {
+		snprintf (key, sizeof (key), "key%d", i);
+		sdb_set (db, key, "1", 0);
+	}
+	sdb_set (db, "gone", "1", 0);
+	sdb_expire_set (db, "gone", 1000, 0);
+	SdbKv *kv = sdb_ht_find_kvp (db->ht, "gone", NULL);
+	kv->expire = sdb_now () - 10;
+	sdb_ht_find_kvp (db->ht, "key1", NULL)->ref = 0;
+	parallel_db = db;
+	sdb_foreach_reduce (db, parallel_gone_cb, parallel_fork_cb, parallel_join_cb, &sum, 4);
+	mu_assert_eq (sum, 101, "expired while scanning");
+	mu_assert_eq (db->ht->count, 101, "not unset during the scan");
+	kv = sdb_ht_find_kvp (db->ht, "key1", NULL);
+	mu_assert ("no clock bit set during the scan", kv && !kv->ref);
+	mu_assert ("expired after", !sdb_const_get (db, "gone", NULL));
+	mu_assert_eq (db->ht->count, 100, "unset after the scan");
+	sdb_free (db);
+	mu_end;
+}
+
+bool test_sdb_index_match(void) {
+	const char *dbname = ".index";
+	SdbListIter *it;
+	SdbKv *kv;
+	SdbList *l;
+	unlink (dbname);
+	Sdb *db = sdb_new (NULL, dbname, false);
+	sdb_config (db, SDB_OPTION_INDEX);
+	sdb_set (db, "fcn.b", "2", 0);
+	sdb_set (db, "fcn.a", "1", 0);
+	sdb_set (db, "sym.imp.x", "3", 0);
+	sdb_set (db, "fcnz", "4", 0);
+	sdb_set (db, "fcn", "5", 0);
+	sdb_sync (db);
+	mu_assert ("file has an index", sdb_index_has (db));
+	sdb_set (db, "fcn.0", "0", 0);
+	sdb_unset (db, "fcn.b", 0);
+	l = sdb_foreach_match (db, "^fcn.", false);
+	mu_assert_eq (ls_length (l), 2, "deleted keys are hidden");
+	it = ls_iterator (l);
+	kv = ls_iter_get (it);
+	mu_assert_streq (sdbkv_key (kv), "fcn.0", "memory keys are merged in order");
+	kv = ls_iter_get (it);
+	mu_assert_streq (sdbkv_key (kv), "fcn.a", "disk keys follow");
+	ls_free (l);
+	l = sdb_foreach_match (db, "^fcn.=1", false);
+	mu_assert_eq (ls_length (l), 1, "value filter");
+	ls_free (l);
+	l = sdb_foreach_match (db, "^fcn$", false);
+	mu_assert_eq (ls_length (l), 1, "exact key");
+	ls_free (l);
+	sdb_free (db);
+	unlink (dbname);
+	mu_end;
+}
+
+static int range_cat_cb(void *user, const char *k, const char *v) {
+	strcat ((char *)user, k);
+	strcat ((char *)user, ",");
+	return 1;
+}
+
+bool test_sdb_range(void) {
+	const char *dbname = ".range";
+	char out[128] = {0};
+	unlink (dbname);
+	Sdb *db = sdb_new (NULL, dbname, false);
+	sdb_set (db, "d", "1", 0);
+	sdb_set (db, "b", "1", 0);
+	sdb_set (db, "a", "1", 0);
+	sdb_set (db, "e", "1", 0);
+	sdb_sync (db);
+	mu_assert ("no index by default", !sdb_index_has (db));
+	sdb_set (db, "c", "1", 0);
+	sdb_unset (db, "d", 0);
+	sdb_range (db, NULL, NULL, range_cat_cb, out);
+	mu_assert_streq (out, "a,b,c,e,", "whole database in order");
+	*out = 0;
+	sdb_range (db, "b", "e", range_cat_cb, out);
+	mu_assert_streq (out, "b,c,", "half open range");
+	sdb_free (db);
+	unlink (dbname);
+	mu_end;
+}
+
+bool test_sdb_memory_limit(void) {
+	const char *dbname = ".memlimit";
+	char key[32];
+	int i, lost = 0;
+	Sdb *db = sdb_new0 ();
+	sdb_memory_limit (db, 4096);
+	for (i = 0; i < 1000; i++) {
+		snprintf (key, sizeof (key), "key%d", i);
+		sdb_set (db, key, "value", 0);
+	}
+	mu_assert ("memory stays under the budget", db->mem <= 4096);
+	mu_assert ("entries were evicted", db->evictions > 0);
+	mu_assert_streq (sdb_const_get (db, "key999", NULL), "value", "last key survives");
+	sdb_free (db);
+
+	unlink (dbname);
+	db = sdb_new (NULL, dbname, false);
+	sdb_memory_limit (db, 4096);
+	for (i = 0; i < 1000; i++) {
+		snprintf (key, sizeof (key), "key%d", i);
+		sdb_num_set (db, key, i, 0);
+	}
+	mu_assert ("dirty entries are written back", db->mem <= 4096);
+	mu_assert_eq ((int)db->evictions, 0, "nothing lost");
+	for (i = 0; i < 1000; i++) {
+		snprintf (key, sizeof (key), "key%d", i);
+		if (sdb_num_get (db, key, NULL) != i) {
+			lost++;
+		}
+	}
+	mu_assert_eq (lost, 0, "all keys kept");
+	sdb_sync (db);
+	for (i = 0; i < 1000; i++) {
+		snprintf (key, sizeof (key), "key%d", i);
+		sdb_num_set (db, key, i, 0);
+	}
+	mu_assert ("clean entries are evicted", db->evictions > 0 && db->mem <= 4096);
+	sdb_free (db);
+	unlink (dbname);
+	mu_end;
+}
+
+// ttls on disk are wall clock seconds, the fast clock must agree with it
+bool test_sdb_now(void) {
+	ut64 now, last = 0, ulast = 0, unow;
+	ut64 wall = (ut64)time (NULL);
+	int i;
+	for (i = 0; i < 100000; i++) {
+		now = sdb_now ();
+		unow = sdb_unow ();
+		mu_assert ("sdb_now goes forward", now >= last);
+		mu_assert ("sdb_unow goes forward", unow >= ulast);
+		last = now;
+		ulast = unow;
+	}
+	ut64 diff = last > wall? last - wall: wall - last;
+	mu_assert ("within a second of time ()", diff <= 1);
+	mu_end;
+}
+
+bool test_sdb_expire_tick(void) {
+	char key[32];
+	int i;
+	Sdb *db = sdb_new0 ();
+	ut64 past = sdb_now () - 10;
+	for (i = 0; i < 100; i++) {
+		snprintf (key, sizeof (key), "key%d", i);
+		sdb_set (db, key, "value", 0);
+		sdb_expire_set (db, key, past, 0);
+	}
+	sdb_set (db, "keep", "value", 0);
+	sdb_expire_set (db, "keep", 1000, 0);
+	mu_assert ("some were reclaimed while setting", db->ht->count < 101);
+	sdb_expire_tick (db, 0);
+	mu_assert_eq (db->ht->count, 1, "expired keys are gone from memory");
+	mu_assert_streq (sdb_const_get (db, "keep", NULL), "value", "live key stays");
+	mu_assert_eq (sdb_expire_tick (db, 0), 0, "nothing left to expire");
+	// reading an expired key unsets it with the caller's hash
+	SdbKey k = sdb_key ("gone");
+	sdb_set (db, "gone", "value", 0);
+	sdb_expire_set (db, "gone", past, 0);
+	mu_assert ("expired on read", !sdb_const_get_key (db, &k, NULL, NULL));
+	mu_assert_eq (db->ht->count, 1, "expired key dropped");
+	sdb_free (db);
+	mu_end;
+}
+
+bool test_sdb_expire_disk(void) {
+	const char *dbname = ".expiredisk";
+	ut64 expire;
+	int sum = 0;
+	unlink (dbname);
+	Sdb *db = sdb_new (NULL, dbname, false);
+	sdb_set (db, "live", "1", 0);
+	sdb_set (db, "plain", "2", 0);
+	sdb_expire_set (db, "live", 100, 0);
+	expire = sdb_expire_get (db, "live", NULL);
+	sdb_sync (db);
+	mu_assert_eq (db->ht->count, 0, "expiring keys are synced too");
+	mu_assert_streq (sdb_const_get (db, "live", NULL), "1", "value on disk");
+	mu_assert ("ttl on disk", sdb_expire_get (db, "live", NULL) == expire);
+	mu_assert_eq (sdb_expire_get (db, "plain", NULL), 0, "no ttl");
+	sdb_free (db);
+
+	db = sdb_new (NULL, dbname, false);
+	mu_assert ("ttl survives reopening", sdb_expire_get (db, "live", NULL) == expire);
+	sdb_set (db, "live", "3", 0);
+	mu_assert ("updates keep the ttl", sdb_expire_get (db, "live", NULL) == expire);
+	// the kept ttl is scheduled, once it passes the tick reclaims the key
+	SdbKv *kv = sdb_ht_find_kvp (db->ht, "live", NULL);
+	mu_assert ("timer pushed", kv && db->ntimers == 1 && db->timers[0].expire == expire);
+	kv->expire = db->timers[0].expire = sdb_now () - 10;
+	sum = sdb_expire_tick (db, 0);
+	mu_assert_eq (sum, 1, "reclaimed by the tick");
+	sum = 0;
+	mu_assert ("gone", !sdb_const_get (db, "live", NULL));
+	sdb_free (db);
+
+	db = sdb_new (NULL, dbname, false);
+	sdb_disk_create (db);
+	sdb_disk_insert_expire (db, "old", "1", sdb_now () - 10);
+	sdb_disk_insert_expire (db, "new", "1", 0);
+	sdb_disk_insert_expire (db, "old2", "1", sdb_now () - 10);
+	sdb_disk_finish (db);
+	mu_assert ("expired on disk", !sdb_const_get (db, "old", NULL));
+	mu_assert_streq (sdb_const_get (db, "new", NULL), "1", "not expiring");
+	// no path reports the expired records
+	mu_assert ("exists", !sdb_exists (db, "old") && sdb_exists (db, "new"));
+	sdb_foreach (db, parallel_sum_cb, &sum);
+	mu_assert_eq (sum, 1, "foreach");
+	sum = 0;
+	sdb_range (db, NULL, NULL, parallel_sum_cb, &sum);
+	mu_assert_eq (sum, 1, "range");
+	sum = 0;
+	sdb_foreach_reduce (db, parallel_sum_cb, parallel_fork_cb, parallel_join_cb, &sum, 2);
+	mu_assert_eq (sum, 1, "parallel foreach");
+	mu_assert ("add over an expired record", sdb_add (db, "old2", "2", 0));
+	// a ttl that already passed is not carried over to a new value
+	sdb_set (db, "old", "fresh", 0);
+	mu_assert_streq (sdb_const_get (db, "old", NULL), "fresh", "new value over an expired one");
+	mu_assert_eq (sdb_expire_get (db, "old", NULL), 0, "old ttl dropped");
+	sdb_unset (db, "old", 0);
+	sdb_sync (db);
+	mu_assert ("dropped by sync", !sdb_exists (db, "old"));
+	sdb_free (db);
+	unlink (dbname);
+	mu_end;
+}
+
+bool test_sdb_disk_cache(void) {
+	const char *dbname = ".diskcache";
+	unlink (dbname);
+	Sdb *db = sdb_new (NULL, dbname, false);
+	sdb_set (db, "hot", "first", 0);
+	sdb_set (db, "cold", "x", 0);
+	sdb_sync (db);
+	mu_assert_streq (sdb_const_get (db, "hot", NULL), "first", "miss");
+	mu_assert ("cache allocated on disk lookups", db->cache);
+	mu_assert_streq (sdb_const_get (db, "hot", NULL), "first", "hit");
+	mu_assert ("missing key", !sdb_const_get (db, "hote", NULL));
+	sdb_set (db, "aaa", "moves the records", 0);
+	sdb_set (db, "hot", "second", 0);
+	sdb_sync (db);
+	mu_assert_streq (sdb_const_get (db, "hot", NULL), "second", "reset on sync");
+	mu_assert_streq (sdb_const_get (db, "cold", NULL), "x", "other keys");
+	sdb_free (db);
+	unlink (dbname);
+	mu_end;
+}
+
+bool test_sdb_bin(void) {
+	const char *dbname = ".binvalues";
+	const ut8 blob[] = { 'a', 0, '\n', 0xff, 0 };
+	const ut8 *v;
+	ut8 *dup, big[400];
+	char text[1000];
+	ut32 i, len;
+	unlink (dbname);
+	unlink (".binvalues.journal");
+	Sdb *db = sdb_new (NULL, dbname, false);
+	sdb_set_bin (db, "blob", blob, sizeof (blob), 0);
+	v = sdb_const_get_bin (db, "blob", &len, NULL);
+	mu_assert_eq (len, sizeof (blob), "length in memory");
+	mu_assert ("bytes in memory", v && !memcmp (v, blob, len));
+	sdb_sync (db);
+	v = sdb_const_get_bin (db, "blob", &len, NULL);
+	mu_assert_eq (len, sizeof (blob), "length on disk");
+	mu_assert ("bytes on disk", v && !memcmp (v, blob, len));
+	dup = sdb_get_bin (db, "blob", &len, NULL);
+	mu_assert ("copy", dup && len == sizeof (blob) && !memcmp (dup, blob, len));
+	free (dup);
+	sdb_free (db);
+
+	db = sdb_new (NULL, dbname, false);
+	v = sdb_const_get_bin (db, "blob", &len, NULL);
+	mu_assert ("survives reopening", v && len == sizeof (blob) && !memcmp (v, blob, len));
+	sdb_journal_open (db);
+	sdb_set_bin (db, "journaled", blob, 3, 0);
+	// long lines are not cut short
+	for (i = 0; i < sizeof (big); i++) {
+		big[i] = (ut8)i;
+	}
+	memset (text, 'x', sizeof (text) - 1);
+	text[sizeof (text) - 1] = 0;
+	sdb_set_bin (db, "big", big, sizeof (big), 0);
+	sdb_set (db, "text", text, 0);
+	Sdb *db2 = sdb_new (NULL, dbname, false);
+	sdb_journal_open (db2);
+	int changes = sdb_journal_load (db2);
+	mu_assert_eq (changes, 3, "journal replayed");
+	v = sdb_const_get_bin (db2, "journaled", &len, NULL);
+	mu_assert ("journal keeps the bytes", v && len == 3 && !memcmp (v, blob, len));
+	v = sdb_const_get_bin (db2, "big", &len, NULL);
+	mu_assert ("long binary value", v && len == sizeof (big) && !memcmp (v, big, len));
+	mu_assert ("long text value", !strcmp (sdb_const_get (db2, "text", NULL), text));
+	sdb_free (db2);
+	sdb_journal_close (db);
+	sdb_free (db);
+	unlink (dbname);
+	mu_end;
+}
+
+static int count_cb(void *user, const char *k, const char *v) {
+	(*(int *)user)++;
+	return 1;
+}
+
+bool test_sdb_bin_zero(void) {
+	const char *dbname = ".binzero";
+	const ut8 zero[] = { 0, 1, 2, 3 };
+	const ut8 *v;
+	int sum = 0;
+	ut32 len;
+	unlink (dbname);
+	Sdb *db = sdb_new (NULL, dbname, false);
+	// a leading zero byte does not make the value look deleted
+	sdb_set_bin (db, "z", zero, sizeof (zero), 0);
+	mu_assert ("exists in memory", sdb_exists (db, "z"));
+	mu_assert ("ttl in memory", sdb_expire_set (db, "z", 1000, 0));
+	sdb_foreach (db, count_cb, &sum);
+	mu_assert_eq (sum, 1, "foreach in memory");
+	sum = 0;
+	sdb_range (db, NULL, NULL, count_cb, &sum);
+	mu_assert_eq (sum, 1, "range in memory");
+	sdb_expire_set (db, "z", 0, 0);
+	sdb_sync (db);
+	mu_assert ("exists on disk", sdb_exists (db, "z"));
+	sum = 0;
+	sdb_foreach_reduce (db, count_cb, parallel_fork_cb, parallel_join_cb, &sum, 2);
+	mu_assert_eq (sum, 1, "parallel foreach");
+	mu_assert ("ttl on disk", sdb_expire_set (db, "z", 1000, 0));
+	v = sdb_const_get_bin (db, "z", &len, NULL);
+	mu_assert ("bytes kept", v && len == sizeof (zero) && !memcmp (v, zero, len));
+	sdb_free (db);
+	unlink (dbname);
+	mu_end;
+}
+
+bool test_sdb_key(void) {
+	const char *dbname = ".keyapi";
+	SdbKey k = sdb_key ("hello");
+	int vlen;
+	unlink (dbname);
+	mu_assert_eq (k.len, 5, "key length");
+	mu_assert ("key hash", k.hash == sdb_hash ("hello"));
+	Sdb *db = sdb_new (NULL, dbname, false);
+	sdb_set_key (db, &k, "world", 0);
+	mu_assert_streq (sdb_const_get (db, "hello", NULL), "world", "set by key");
+	sdb_set_len (db, "hello", 5, "again", 0);
+	mu_assert_streq (sdb_const_get_key (db, &k, &vlen, NULL), "again", "set by length");
+	mu_assert_eq (vlen, 5, "value length");
+	sdb_sync (db);
+	mu_assert_streq (sdb_const_get_keylen (db, "hello", 5, NULL, NULL), "again", "disk by length");
+	mu_assert_streq (sdb_const_get_key (db, &k, NULL, NULL), "again", "disk by key");
+	sdb_set_key (db, &k, "", 0);
+	mu_assert ("unset by key", !sdb_const_get_key (db, &k, NULL, NULL));
+	sdb_free (db);
+	unlink (dbname);
+	mu_end;
+}
+
+static void batch_hook_cb(Sdb *s, void *user, const char *k, const char *v) {
+	(*(int *)user)++;
+}
+
+bool test_sdb_set_batch(void) {
+	const char *dbname = ".setbatch";
+	SdbKvPair pairs[1000];
+	char keys[1000][16];
+	int i, calls = 0;
+	unlink (dbname);
+	unlink (".setbatch.journal");
+	for (i = 0; i < 1000; i++) {
+		snprintf (keys[i], sizeof (keys[i]), "sym.%d", i);
+		pairs[i].key = keys[i];
+		pairs[i].value = keys[i] + 4;
+	}
+	Sdb *db = sdb_new (NULL, dbname, false);
+	sdb_hook (db, batch_hook_cb, &calls);
+	sdb_journal_open (db);
+	int stored = sdb_set_batch (db, pairs, 1000, 0);
+	mu_assert_eq (stored, 1000, "stored");
+	mu_assert_eq (calls, 1, "one hook call per batch");
+	mu_assert ("table sized up front", db->ht->size >= 1000);
+	mu_assert_streq (sdb_const_get (db, "sym.42", NULL), "42", "value");
+	Sdb *db2 = sdb_new (NULL, dbname, false);
+	sdb_journal_open (db2);
+	int changes = sdb_journal_load (db2);
+	mu_assert_eq (changes, 1000, "one journal line per pair");
+	mu_assert_streq (sdb_const_get (db2, "sym.999", NULL), "999", "replayed");
+	sdb_free (db2);
+	sdb_sync (db);
+	pairs[0].value = "changed";
+	stored = sdb_set_batch (db, pairs, 1, SDB_BATCH_NODISK);
+	mu_assert_eq (stored, 1, "new key");
+	mu_assert_streq (sdb_const_get (db, "sym.0", NULL), "changed", "shadows the file");
+	sdb_journal_close (db);
+	sdb_free (db);
+	unlink (dbname);
+	mu_end;
+}
+
+static void builder_progress_cb(void *user, ut64 records, ut64 bytes) {
+	*(ut64 *)user = records;
+}
+
+static bool builder_fill(const char *dbname, int dups, ut64 *seen) {
+	char key[32], val[32];
+	int i;
+	SdbBuilder *b = sdb_builder_new (dbname, dups);
+	if (!b) {
+		return false;
+	}
+	// 64 pairs in memory force the (hash,pos) pairs into several runs
+	sdb_builder_memory (b, 64 * 8);
+	sdb_builder_progress (b, builder_progress_cb, seen, 100);
+	for (i = 0; i < 1000; i++) {
+		snprintf (key, sizeof (key), "k%d", i);
+		snprintf (val, sizeof (val), "%d", i);
+		sdb_builder_add (b, key, val);
+	}
+	sdb_builder_add (b, "k1", "again");
+	sdb_builder_add (b, "k500", "again");
+	return sdb_builder_finish (b);
+}
+
+bool test_sdb_builder(void) {
+	const char *dbname = ".builder";
+	ut64 seen = 0;
+	unlink (dbname);
+	mu_assert ("finish", builder_fill (dbname, SDB_BUILDER_DUP_FIRST, &seen));
+	mu_assert_eq ((int)seen, 1000, "duplicates dropped");
+	mu_assert ("spill removed", access (".builder.spill", F_OK) == -1);
+	Sdb *db = sdb_new (NULL, dbname, false);
+	mu_assert_streq (sdb_const_get (db, "k1", NULL), "1", "first wins");
+	mu_assert_streq (sdb_const_get (db, "k999", NULL), "999", "spilled key");
+	int count = sdb_count (db);
+	mu_assert_eq (count, 1000, "count");
+	sdb_free (db);
+	mu_assert ("finish", builder_fill (dbname, SDB_BUILDER_DUP_LAST, &seen));
+	db = sdb_new (NULL, dbname, false);
+	mu_assert_streq (sdb_const_get (db, "k500", NULL), "again", "last wins");
+	mu_assert_streq (sdb_const_get (db, "k2", NULL), "2", "other keys");
+	sdb_free (db);
+	mu_assert ("finish", builder_fill (dbname, SDB_BUILDER_DUP_KEEP, &seen));
+	mu_assert_eq ((int)seen, 1002, "all records kept");
+	unlink (dbname);
+	mu_end;
+}
+
+bool test_sdb_make_parallel(void) {
+	const char *dbname = ".makepar";
+	char key[32], val[32];
+	int i, bad = 0;
+	unlink (dbname);
+	// enough records for the tables to be built by several threads
+	Sdb *db = sdb_new (NULL, dbname, false);
+	for (i = 0; i < 100000; i++) {
+		snprintf (key, sizeof (key), "key.%d", i);
+		snprintf (val, sizeof (val), "%d", i);
+		sdb_set (db, key, val, 0);
+	}
+	mu_assert ("sync", sdb_sync (db));
+	sdb_free (db);
+	db = sdb_new (NULL, dbname, false);
+	for (i = 0; i < 100000; i++) {
+		snprintf (key, sizeof (key), "key.%d", i);
+		snprintf (val, sizeof (val), "%d", i);
+		const char *v = sdb_const_get (db, key, NULL);
+		if (!v || strcmp (v, val)) {
+			bad++;
+		}
+	}
+	mu_assert_eq (bad, 0, "every key found");
+	int count = sdb_count (db);
+	mu_assert_eq (count, 100000, "count");
+	sdb_free (db);
+	unlink (dbname);
+	mu_end;
+}
+
+bool test_sdb_cluster(void) {
+	const char *dbname = ".cluster";
+	char key[32], val[32];
+	const char *k, *v;
+	int i, bad = 0, unordered = 0, last = 0;
+	SdbCursor c;
+	unlink (dbname);
+	Sdb *db = sdb_new (NULL, dbname, false);
+	sdb_config (db, SDB_OPTION_CLUSTER | SDB_OPTION_INDEX);
+	for (i = 0; i < 5000; i++) {
+		snprintf (key, sizeof (key), "k%d", i);
+		snprintf (val, sizeof (val), "%d", i);
+		sdb_set (db, key, val, 0);
+	}
+	sdb_expire_set (db, "k42", 100, 0);
+	ut64 expire = sdb_expire_get (db, "k42", NULL);
+	mu_assert ("sync", sdb_sync (db));
+	sdb_free (db);
+	db = sdb_new (NULL, dbname, false);
+	sdb_cursor_begin (db, &c);
+	while (sdb_cursor_next (db, &c, &k, &v, NULL)) {
+		int table = sdb_hash (k) & 0xff;
+		if (table < last) {
+			unordered++;
+		}
+		last = table;
+	}
+	mu_assert_eq (unordered, 0, "records grouped by table");
+	for (i = 0; i < 5000; i++) {
+		snprintf (key, sizeof (key), "k%d", i);
+		snprintf (val, sizeof (val), "%d", i);
+		v = sdb_const_get (db, key, NULL);
+		if (!v || strcmp (v, val)) {
+			bad++;
+		}
+	}
+	mu_assert_eq (bad, 0, "every key found");
+	mu_assert ("ttl moved along", sdb_expire_get (db, "k42", NULL) == expire);
+	mu_assert_eq (sdb_expire_get (db, "k43", NULL), 0, "no ttl");
+	SdbList *l = sdb_foreach_match (db, "^k499", false);
+	mu_assert_eq (ls_length (l), 11, "index moved along");
+	ls_free (l);
+	sdb_free (db);
+	unlink (dbname);
+	mu_end;
+}
+
+static int advice_cb(void *user, const char *k, const char *v) {
+	Sdb *db = user;
+	return db->db.advice == CDB_ADVICE_RANDOM;
+}
+
+bool test_sdb_advice(void) {
+	const char *dbname = ".advice";
+	unlink (dbname);
+	Sdb *db = sdb_new (NULL, dbname, false);
+	sdb_set (db, "a", "1", 0);
+	sdb_set (db, "b", "2", 0);
+	sdb_sync (db);
+	sdb_config (db, SDB_OPTION_RANDOM | SDB_OPTION_WILLNEED);
+	mu_assert_eq (db->db.advice, CDB_ADVICE_RANDOM | CDB_ADVICE_WILLNEED, "advice");
+	sdb_set (db, "c", "3", 0);
+	sdb_sync (db);
+	mu_assert_eq (db->db.advice, CDB_ADVICE_RANDOM | CDB_ADVICE_WILLNEED, "kept on sync");
+	mu_assert_streq (sdb_const_get (db, "a", NULL), "1", "prefaulted map");
+	sdb_config (db, SDB_OPTION_RANDOM);
+	mu_assert ("scan", sdb_foreach (db, advice_cb, db));
+	mu_assert_eq (db->db.advice, CDB_ADVICE_RANDOM, "restored after the scan");
+	sdb_config (db, SDB_OPTION_SEQUENTIAL | SDB_OPTION_HUGEPAGES);
+	mu_assert_eq (db->db.advice, CDB_ADVICE_SEQUENTIAL | CDB_ADVICE_HUGEPAGE, "advice");
+	mu_assert_streq (sdb_const_get (db, "c", NULL), "3", "lookup");
+	sdb_free (db);
+	unlink (dbname);
+	mu_end;
+}
+
+bool test_sdb_nomap(void) {
+	const char *dbname = ".nomap";
+	char key[32], val[64];
+	const char *v;
+	int i, bad = 0;
+	unlink (dbname);
+	Sdb *db = sdb_new (NULL, dbname, false);
+	sdb_config (db, SDB_OPTION_NOMAP | SDB_OPTION_INDEX);
+	sdb_page_cache (db, 16 * CDB_PAGE_SIZE);
+	for (i = 0; i < 3000; i++) {
+		snprintf (key, sizeof (key), "k%d", i);
+		snprintf (val, sizeof (val), "value number %d of the unmapped file", i);
+		sdb_set (db, key, val, 0);
+	}
+	sdb_expire_set (db, "k42", 100, 0);
+	ut64 expire = sdb_expire_get (db, "k42", NULL);
+	mu_assert ("sync", sdb_sync (db));
+	mu_assert ("not mapped", !db->db.map && db->db.pc);
+	mu_assert_eq (db->db.pc->npages, 16, "bounded cache");
+	for (i = 0; i < 3000; i++) {
+		snprintf (key, sizeof (key), "k%d", i);
+		snprintf (val, sizeof (val), "value number %d of the unmapped file", i);
+		v = sdb_const_get (db, key, NULL);
+		if (!v || strcmp (v, val)) {
+			bad++;
+		}
+	}
+	mu_assert_eq (bad, 0, "every key found");
+	mu_assert ("misses", db->db.pc->misses > 16);
+	mu_assert ("ttl section", sdb_expire_get (db, "k42", NULL) == expire);
+	SdbList *l = sdb_foreach_list (db, false);
+	int count = ls_length (l);
+	mu_assert_eq (count, 3000, "foreach");
+	ls_free (l);
+	l = sdb_foreach_match (db, "^k299", false);
+	mu_assert_eq (ls_length (l), 11, "index section");
+	ls_free (l);
+	sdb_set (db, "k1", "changed", 0);
+	mu_assert ("sync again", sdb_sync (db));
+	mu_assert_streq (sdb_const_get (db, "k1", NULL), "changed", "round trip");
+	sdb_free (db);
+	unlink (dbname);
+	mu_end;
+}
+
+bool test_sdb_async(void) {
+	const char *dbname = ".async";
+	char key[32], val[128];
+	const char *v;
+	int i, bad = 0;
+	unlink (dbname);
+	Sdb *db = sdb_new (NULL, dbname, false);
+	sdb_config (db, SDB_OPTION_ASYNC | SDB_OPTION_CLUSTER | SDB_OPTION_INDEX);
+	for (i = 0; i < 50000; i++) {
+		snprintf (key, sizeof (key), "k%d", i);
+		snprintf (val, sizeof (val), "value %d written from the background thread", i);
+		sdb_set (db, key, val, 0);
+	}
+	sdb_expire_set (db, "k42", 100, 0);
+	ut64 expire = sdb_expire_get (db, "k42", NULL);
+	mu_assert ("sync", sdb_sync (db));
+	mu_assert ("writer stopped", !db->m.w);
+	sdb_free (db);
+	db = sdb_new (NULL, dbname, false);
+	for (i = 0; i < 50000; i++) {
+		snprintf (key, sizeof (key), "k%d", i);
+		snprintf (val, sizeof (val), "value %d written from the background thread", i);
+		v = sdb_const_get (db, key, NULL);
+		if (!v || strcmp (v, val)) {
+			bad++;
+		}
+	}
+	mu_assert_eq (bad, 0, "every key found");
+	mu_assert ("ttl section", sdb_expire_get (db, "k42", NULL) == expire);
+	SdbList *l = sdb_foreach_match (db, "^k4999", false);
+	mu_assert_eq (ls_length (l), 11, "index section");
+	ls_free (l);
+	sdb_free (db);
+	unlink (dbname);
+	mu_end;
+}
+
+bool test_sdb_write_buffer(void) {
+	const char *dbname = ".wbuf";
+	char key[32], val[32], space[4096];
+	const char *v;
+	int i, bad = 0;
+	// values larger than the buffer skip it
+	char *big = malloc (200000);
+	mu_assert ("alloc", big);
+	memset (big, 'x', 199999);
+	big[199999] = 0;
+	unlink (dbname);
+	Sdb *db = sdb_new (NULL, dbname, false);
+	sdb_config (db, SDB_OPTION_CLUSTER);
+	sdb_write_buffer (db, 65536);
+	for (i = 0; i < 10000; i++) {
+		snprintf (key, sizeof (key), "k%d", i);
+		snprintf (val, sizeof (val), "%d", i);
+		sdb_set (db, key, (i % 1000)? val: big, 0);
+	}
+	mu_assert ("sync", sdb_sync (db));
+	sdb_free (db);
+	db = sdb_new (NULL, dbname, false);
+	for (i = 0; i < 10000; i++) {
+		snprintf (key, sizeof (key), "k%d", i);
+		snprintf (val, sizeof (val), "%d", i);
+		v = sdb_const_get (db, key, NULL);
+		if (!v || strcmp (v, (i % 1000)? val: big)) {
+			bad++;
+		}
+	}
+	mu_assert_eq (bad, 0, "every key found");
+	sdb_free (db);
+	SdbBuilder *b = sdb_builder_new (dbname, SDB_BUILDER_DUP_KEEP);
+	mu_assert ("caller buffer", sdb_builder_buffer (b, space, sizeof (space)));
+	sdb_builder_add (b, "small", "1");
+	sdb_builder_add (b, "big", big);
+	sdb_builder_add (b, "after", "2");
+	mu_assert ("finish", sdb_builder_finish (b));
+	db = sdb_new (NULL, dbname, false);
+	mu_assert_streq (sdb_const_get (db, "small", NULL), "1", "before");
+	v = sdb_const_get (db, "big", NULL);
+	mu_assert ("written in place", v && !strcmp (v, big));
+	mu_assert_streq (sdb_const_get (db, "after", NULL), "2", "after");
+	sdb_free (db);
+	free (big);
+	unlink (dbname);
+	mu_end;
+}
+
+static bool corrupt(const char *file, const char *what) {
+	bool ret = false;
+	int fd = open (file, O_RDWR);
+	struct stat st;
+	char *buf;
+	if (fd == -1 || fstat (fd, &st) || !(buf = malloc (st.st_size))) {
+		return false;
+	}
+	if (read (fd, buf, st.st_size) == st.st_size) {
+		size_t i, len = strlen (what);
+		for (i = 0; i + len <= (size_t)st.st_size; i++) {
+			if (!memcmp (buf + i, what, len)) {
+				ret = lseek (fd, i, SEEK_SET) != -1 && write (fd, "X", 1) == 1;
+				break;
+			}
+		}
+	}
+	free (buf);
+	close (fd);
+	return ret;
+}
+
+bool test_sdb_checksum(void) {
+	const char *dbname = ".checksum";
+	char key[32], val[32];
+	SdbVerify v;
+	int i;
+	unlink (dbname);
+	Sdb *db = sdb_new (NULL, dbname, false);
+	sdb_config (db, SDB_OPTION_CHECKSUM | SDB_OPTION_CLUSTER | SDB_OPTION_INDEX);
+	for (i = 0; i < 5000; i++) {
+		snprintf (key, sizeof (key), "k%d", i);
+		snprintf (val, sizeof (val), "%d", i);
+		sdb_set (db, key, val, 0);
+	}
+	sdb_set (db, "victim", "corruptme", 0);
+	mu_assert ("sync", sdb_sync (db));
+	mu_assert ("verify", sdb_verify (db, &v, 4));
+	mu_assert ("crc section", v.hascrc && v.hassum && !v.badsum);
+	mu_assert_eq (v.records, 5001, "records checked");
+	sdb_free (db);
+	// rewritten without the option, the checksums stay
+	db = sdb_new (NULL, dbname, false);
+	sdb_set (db, "k1", "changed", 0);
+	mu_assert ("sync", sdb_sync (db));
+	mu_assert ("verify again", sdb_verify (db, &v, 1) && v.hassum);
+	sdb_free (db);
+	mu_assert ("corrupt", corrupt (dbname, "corruptme"));
+	db = sdb_new (NULL, dbname, false);
+	mu_assert ("corruption found", !sdb_verify (db, &v, 0));
+	mu_assert_eq (v.badrec, 1, "one bad record");
+	mu_assert_eq (v.badslot, 0, "tables fine");
+	mu_assert ("file checksum", v.badsum);
+	mu_assert_streq (sdb_const_get (db, "victim", NULL), "Xorruptme", "read as is");
+	sdb_config (db, SDB_OPTION_VERIFY);
+	mu_assert ("bad record not found", !sdb_const_get (db, "victim", NULL));
+	mu_assert_streq (sdb_const_get (db, "k1", NULL), "changed", "good record");
+	sdb_free (db);
+	unlink (dbname);
+	mu_end;
+}
+
+static ut64 file_size(const char *file) {
+	struct stat st;
+	return stat (file, &st)? 0: (ut64)st.st_size;
+}
+
+static int compress_count(void *user, const char *k, const char *v) {
+	int *n = user;
+	if (!strncmp (k, "k", 1) && strstr (v, "\"addr\":\"0x")) {
+		(*n)++;
+	}
+	return 1;
+}
+
+static int compress_count_any(void *user, const char *k, const char *v) {
+	(*(int *)user)++;
+	return 1;
+}
+
+static void *compress_fork(void *user) {
+	return calloc (1, sizeof (int));
+}
+
+static void compress_join(void *user, void *tuser) {
+	*(int *)user += *(int *)tuser;
+	free (tuser);
+}
+
+bool test_sdb_compress(void) {
+	const char *dbname = ".compress", *plain = ".compress.plain";
+	char key[32], val[128], out[256], raw[4096];
+	const char *v;
+	SdbVerify sv;
+	ut32 i, n, zlen;
+	int count = 0;
+	for (i = 0; i < sizeof (raw); i++) {
+		raw[i] = "0x4000,0x4010,"[i % 14];
+	}
+	zlen = sdb_lz_compress ((const ut8 *)raw, sizeof (raw), (ut8 *)out, sizeof (out));
+	mu_assert ("lz shrinks", zlen > 0 && zlen < sizeof (out));
+	mu_assert ("lz roundtrip", sdb_lz_decompress ((const ut8 *)out, zlen, (ut8 *)raw, sizeof (raw), &n));
+	mu_assert_eq (n, sizeof (raw), "lz length");
+	mu_assert ("lz content", !memcmp (raw + 14 * 100, "0x4000,0x4010,", 14));
+	mu_assert ("lz truncated", !sdb_lz_decompress ((const ut8 *)out, zlen, (ut8 *)raw, 100, &n));
+	unlink (dbname);
+	unlink (plain);
+	Sdb *db = sdb_new (NULL, dbname, false);
+	Sdb *pl = sdb_new (NULL, plain, false);
+	sdb_config (db, SDB_OPTION_COMPRESS | SDB_OPTION_CLUSTER | SDB_OPTION_INDEX | SDB_OPTION_CHECKSUM);
+	for (i = 0; i < 20000; i++) {
+		snprintf (key, sizeof (key), "k%d", i);
+		snprintf (val, sizeof (val), "{\"addr\":\"0x%08x\",\"name\":\"sym.func.%d\",\"size\":%d}",
+			0x400000 + i * 16, i, i % 100);
+		sdb_set (db, key, val, 0);
+		sdb_set (pl, key, val, 0);
+	}
+	sdb_set (db, "short", "42", 0);
+	sdb_set (db, "ttl", "a value long enough for a block", 0);
+	sdb_expire_set (db, "ttl", sdb_now () + 1000, 0);
+	mu_assert ("sync", sdb_sync (db) && sdb_sync (pl));
+	mu_assert ("compressed", cdb_compressed (&db->db) && db->db.nzblocks > 1);
+	// keys and tables stay as they are, the values shrink a lot more
+	cdb_section (&db->db, CDB_SECT_ZDATA, &zlen);
+	mu_assert ("values smaller", zlen * 3 < 20000 * 60);
+	mu_assert ("smaller", file_size (dbname) < file_size (plain));
+	sdb_free (pl);
+	sdb_free (db);
+	db = sdb_new (NULL, dbname, false);
+	mu_assert_streq (sdb_const_get (db, "k1234", NULL),
+		"{\"addr\":\"0x00404d20\",\"name\":\"sym.func.1234\",\"size\":34}", "block value");
+	mu_assert_streq (sdb_const_get (db, "short", NULL), "42", "inline value");
+	mu_assert ("exists", sdb_exists (db, "k7") && sdb_exists (db, "short") && !sdb_exists (db, "nope"));
+	mu_assert ("ttl kept", sdb_expire_get (db, "ttl", NULL) > sdb_now ());
+	v = sdb_const_get (db, "k19999", NULL);
+	mu_assert ("last block", v && strstr (v, "sym.func.19999"));
+	sdb_foreach_reduce (db, compress_count, compress_fork, compress_join, &count, 4);
+	mu_assert_eq (count, 20000, "foreach decodes");
+	mu_assert ("verify", sdb_verify (db, &sv, 4) && !sv.badblock);
+	// rewritten without the option, values stay compressed
+	sdb_set (db, "k1", "changed", 0);
+	mu_assert ("sync", sdb_sync (db));
+	mu_assert ("still compressed", cdb_compressed (&db->db));
+	mu_assert_streq (sdb_const_get (db, "k1", NULL), "changed", "changed");
+	sdb_free (db);
+	db = sdb_new (NULL, dbname, false);
+	sdb_config (db, SDB_OPTION_NOMAP);
+	mu_assert_streq (sdb_const_get (db, "k2", NULL),
+		"{\"addr\":\"0x00400020\",\"name\":\"sym.func.2\",\"size\":2}", "unmapped");
+	count = 0;
+	sdb_foreach_reduce (db, compress_count, compress_fork, compress_join, &count, 4);
+	mu_assert_eq (count, 19999, "unmapped foreach");
+	sdb_free (db);
+	unlink (dbname);
+	unlink (plain);
+	mu_end;
+}
+
+typedef struct {
+	int count;
+	char last[64];
+	bool unordered;
+} SortedWalk;
+
+static int sorted_walk(void *user, const char *k, const char *v) {
+	SortedWalk *w = user;
+	if (*w->last && strcmp (w->last, k) >= 0) {
+		w->unordered = true;
+	}
+	snprintf (w->last, sizeof (w->last), "%s", k);
+	w->count++;
+	return 1;
+}
+
+static bool sorted_fill(const char *dbname, bool sorted) {
+	char key[64], val[32];
+	int i;
+	SdbBuilder *b = sdb_builder_new (dbname, SDB_BUILDER_DUP_KEEP);
+	if (!b || (sorted && !sdb_builder_sorted (b, 0))) {
+		return false;
+	}
+	for (i = 0; i < 20000; i++) {
+		if (i < 10000) {
+			snprintf (key, sizeof (key), "fcn.0x0040%04x", i);
+		} else {
+			snprintf (key, sizeof (key), "sym.imp.func.%05d", i);
+		}
+		snprintf (val, sizeof (val), "%d", i);
+		if (!sdb_builder_add (b, key, val)) {
+			sdb_builder_free (b);
+			return false;
+		}
+	}
+	return sdb_builder_finish (b);
+}
+
+bool test_sdb_builder_sorted(void) {
+	const char *dbname = ".sorted", *plain = ".sorted.plain";
+	SortedWalk w = {0};
+	int count = 0, bad = 0, i;
+	char key[64], val[32];
+	SdbVerify v;
+	unlink (dbname);
+	SdbBuilder *b = sdb_builder_new (dbname, SDB_BUILDER_DUP_KEEP);
+	mu_assert ("sorted", sdb_builder_sorted (b, 4));
+	mu_assert ("first", sdb_builder_add (b, "b", "1"));
+	mu_assert ("out of order", !sdb_builder_add (b, "a", "2"));
+	mu_assert ("same key", !sdb_builder_add (b, "b", "3"));
+	mu_assert ("longer", sdb_builder_add (b, "ba", "4"));
+	sdb_builder_free (b);
+	mu_assert ("fill", sorted_fill (dbname, true) && sorted_fill (plain, false));
+	mu_assert ("smaller", file_size (dbname) * 3 < file_size (plain) * 2);
+	Sdb *db = sdb_new (NULL, dbname, false);
+	mu_assert ("sorted file", cdb_sorted (&db->db) && db->db.nkeys == 20000);
+	for (i = 0; i < 20000; i++) {
+		if (i < 10000) {
+			snprintf (key, sizeof (key), "fcn.0x0040%04x", i);
+		} else {
+			snprintf (key, sizeof (key), "sym.imp.func.%05d", i);
+		}
+		snprintf (val, sizeof (val), "%d", i);
+		const char *got = sdb_const_get (db, key, NULL);
+		if (!got || strcmp (got, val)) {
+			bad++;
+		}
+	}
+	mu_assert_eq (bad, 0, "every key found");
+	mu_assert ("before first", !sdb_const_get (db, "a", NULL));
+	mu_assert ("between", !sdb_const_get (db, "fcn.0x0040000", NULL));
+	mu_assert ("after last", !sdb_const_get (db, "zzz", NULL));
+	mu_assert ("exists", sdb_exists (db, "sym.imp.func.19999") && !sdb_exists (db, "sym.imp"));
+	mu_assert_eq (sdb_count (db), 20000, "count");
+	sdb_foreach (db, sorted_walk, &w);
+	mu_assert_eq (w.count, 20000, "foreach");
+	mu_assert ("foreach in order", !w.unordered);
+	memset (&w, 0, sizeof (w));
+	mu_assert ("range", sdb_range (db, "fcn.0x00402000", "sym.imp.func.10100", sorted_walk, &w));
+	mu_assert_eq (w.count, 10000 - 0x2000 + 100, "range count");
+	mu_assert ("range in order", !w.unordered);
+	sdb_foreach_reduce (db, compress_count_any, compress_fork, compress_join, &count, 4);
+	mu_assert_eq (count, 20000, "parallel foreach");
+	mu_assert ("verify", sdb_verify (db, &v, 4));
+	sdb_config (db, SDB_OPTION_NOMAP);
+	mu_assert_streq (sdb_const_get (db, "sym.imp.func.12345", NULL), "12345", "unmapped");
+	// a sync writes the usual layout back
+	sdb_set (db, "new", "key", 0);
+	mu_assert ("sync", sdb_sync (db));
+	mu_assert ("hash tables", !cdb_sorted (&db->db));
+	mu_assert_streq (sdb_const_get (db, "fcn.0x00400100", NULL), "256", "kept");
+	mu_assert_streq (sdb_const_get (db, "new", NULL), "key", "new key");
+	sdb_free (db);
+	unlink (dbname);
+	unlink (plain);
+	mu_end;
+}
+
+static const char *dedup_types[] = {
+	"struct sockaddr_in *",
+	"const char *restrict",
+	"{\"type\":\"func\",\"cc\":\"amd64\"}",
+	"unsigned long long int",
+};
+
+bool test_sdb_dedup(void) {
+	const char *dbname = ".dedup", *plain = ".dedup.plain";
+	char key[32], val[64];
+	const char *a, *b;
+	SdbVerify sv;
+	ut32 zlen;
+	int i, count = 0;
+	unlink (dbname);
+	unlink (plain);
+	Sdb *db = sdb_new (NULL, dbname, false);
+	Sdb *pl = sdb_new (NULL, plain, false);
+	sdb_config (db, SDB_OPTION_DEDUP);
+	for (i = 0; i < 20000; i++) {
+		snprintf (key, sizeof (key), "k%d", i);
+		sdb_set (db, key, dedup_types[i % 4], 0);
+		sdb_set (pl, key, dedup_types[i % 4], 0);
+	}
+	// unique values still go to the blocks
+	for (i = 0; i < 100; i++) {
+		snprintf (key, sizeof (key), "u%d", i);
+		snprintf (val, sizeof (val), "a value only used once, number %d", i);
+		sdb_set (db, key, val, 0);
+	}
+	sdb_set (db, "short", "true", 0);
+	mu_assert ("sync", sdb_sync (db) && sdb_sync (pl));
+	mu_assert ("stubs", cdb_compressed (&db->db));
+	cdb_section (&db->db, CDB_SECT_ZDATA, &zlen);
+	mu_assert ("stored once", zlen < 4096);
+	mu_assert ("smaller", file_size (dbname) * 3 < file_size (plain) * 2);
+	// raw blocks are read in place, copies of a value are the same bytes
+	a = sdb_const_get (db, "k1", NULL);
+	b = sdb_const_get (db, "k19997", NULL);
+	mu_assert_streq (a, dedup_types[1], "first copy");
+	if (db->db.map) {
+		mu_assert ("same value", a == b);
+		mu_assert ("in the map", a >= db->db.map && a < db->db.map + db->db.size);
+	}
+	mu_assert_streq (sdb_const_get (db, "u42", NULL), "a value only used once, number 42", "unique");
+	mu_assert_streq (sdb_const_get (db, "short", NULL), "true", "inline");
+	sdb_foreach_reduce (db, compress_count_any, compress_fork, compress_join, &count, 4);
+	mu_assert_eq (count, 20101, "foreach");
+	mu_assert ("verify", sdb_verify (db, &sv, 4) && !sv.badblock && !sv.badrec);
+	// rewritten without the option, values stay interned and raw
+	sdb_set (db, "k0", "changed", 0);
+	mu_assert ("sync", sdb_sync (db));
+	cdb_section (&db->db, CDB_SECT_ZDATA, &zlen);
+	mu_assert ("still once", cdb_compressed (&db->db) && zlen < 4096);
+	mu_assert_streq (sdb_const_get (db, "k0", NULL), "changed", "changed");
+	mu_assert ("still in place", !db->db.map || sdb_const_get (db, "k2", NULL) == sdb_const_get (db, "k6", NULL));
+	sdb_free (db);
+	// and along with compression
+	db = sdb_new (NULL, dbname, false);
+	sdb_config (db, SDB_OPTION_DEDUP | SDB_OPTION_COMPRESS);
+	sdb_set (db, "k0", dedup_types[0], 0);
+	mu_assert ("sync", sdb_sync (db));
+	mu_assert_streq (sdb_const_get (db, "k3", NULL), dedup_types[3], "compressed");
+	sdb_free (db);
+	db = sdb_new (NULL, dbname, false);
+	sdb_config (db, SDB_OPTION_NOMAP);
+	mu_assert_streq (sdb_const_get (db, "k4", NULL), dedup_types[0], "unmapped");
+	mu_assert_streq (sdb_const_get (db, "u7", NULL), "a value only used once, number 7", "unmapped unique");
+	sdb_free (db);
+	sdb_free (pl);
+	unlink (dbname);
+	unlink (plain);
+	mu_end;
+}
+
+static void num_hook_cb(Sdb *s, void *user, const char *k, const char *v) {
+	snprintf ((char *)user, 32, "%s", v);
+}
+
+bool test_sdb_num_typed(void) {
+	const char *dbname = ".numtyped";
+	char last[32] = {0};
+	ut32 cas;
+	int i;
+	unlink (dbname);
+	Sdb *db = sdb_new (NULL, dbname, false);
+	sdb_num_set (db, "ctr", 0, 0);
+	for (i = 0; i < 100000; i++) {
+		sdb_num_inc (db, "ctr", 1, 0);
+	}
+	// kept as a number, its text rendered in place by the writer
+	SdbKv *kv = sdb_ht_find_kvp (db->ht, "ctr", NULL);
+	mu_assert ("typed", kv && kv->nbase == 10 && kv->num == 100000);
+	mu_assert_eq (sdb_num_get (db, "ctr", NULL), 100000, "number");
+	mu_assert ("rendered", !strcmp (kv->base.value, "100000") && kv->base.value_len == 6);
+	mu_assert_streq (sdb_const_get (db, "ctr", NULL), "100000", "text");
+	sdb_num_dec (db, "ctr", 99990, 0);
+	mu_assert_streq (sdb_const_get (db, "ctr", NULL), "10", "dec");
+	// the base of the value is kept
+	sdb_set (db, "addr", "0x4000", 0);
+	sdb_num_inc (db, "addr", 1, 0);
+	sdb_num_inc (db, "addr", 0x100, 0);
+	mu_assert_streq (sdb_const_get (db, "addr", NULL), "0x4101", "hex");
+	// octal loses its leading zero on the first update, like sdb_itoa does
+	ut64 o;
+	sdb_set (db, "oct", "010", 0);
+	o = sdb_num_inc (db, "oct", 1, 0);
+	mu_assert_eq (o, 9, "octal parsed");
+	mu_assert_streq (sdb_const_get (db, "oct", NULL), "11", "octal text");
+	o = sdb_num_inc (db, "oct", 1, 0);
+	mu_assert_eq (o, 12, "read back as decimal");
+	o = sdb_num_inc (db, "oct", 1, 0);
+	mu_assert_eq (o, 13, "typed from here");
+	mu_assert_streq (sdb_const_get (db, "oct", NULL), "13", "text matches");
+	sdb_num_get (db, "addr", &cas);
+	mu_assert ("cas mismatch", !sdb_num_set (db, "addr", 1, cas + 1));
+	mu_assert ("cas", sdb_num_set (db, "addr", 0x5000, cas));
+	// a string replaces the number
+	sdb_set (db, "ctr", "abc", 0);
+	mu_assert_streq (sdb_const_get (db, "ctr", NULL), "abc", "string");
+	kv = sdb_ht_find_kvp (db->ht, "ctr", NULL);
+	mu_assert ("untyped", kv && !kv->nbase);
+	sdb_num_set (db, "ctr", 123456789, 0);
+	sdb_num_inc (db, "ctr", 1, 0);
+	// hooks see every value
+	sdb_hook (db, num_hook_cb, last);
+	sdb_num_inc (db, "ctr", 1, 0);
+	mu_assert_streq (last, "123456791", "hook");
+	sdb_hook_free (db);
+	sdb_num_inc (db, "ctr", 1, 0);
+	mu_assert ("sync", sdb_sync (db));
+	sdb_free (db);
+	db = sdb_new (NULL, dbname, false);
+	mu_assert_streq (sdb_const_get (db, "ctr", NULL), "123456792", "on disk");
+	mu_assert_streq (sdb_const_get (db, "addr", NULL), "0x5000", "hex on disk");
+	ut64 n = sdb_num_inc (db, "addr", 1, 0);
+	mu_assert_eq (n, 0x5001, "from disk");
+	sdb_free (db);
+	unlink (dbname);
+	mu_end;
+}
+
 int all_tests() {
 	// XXX two bugs found with crash
 	mu_run_test (test_sdb_namespace);
@@ -191,6 +1450,35 @@ int all_tests() {
 	mu_run_test (test_sdb_milset_random);
 	mu_run_test (test_sdb_list_big);
 	mu_run_test (test_sdb_foreach_filter);
+	mu_run_test (test_sdb_foreach_nested);
+	mu_run_test (test_sdb_cursor);
+	mu_run_test (test_sdb_cursor_next);
+	mu_run_test (test_sdb_set_twice);
+	mu_run_test (test_sdb_foreach_parallel);
+	mu_run_test (test_sdb_foreach_parallel_readonly);
+	mu_run_test (test_sdb_index_match);
+	mu_run_test (test_sdb_range);
+	mu_run_test (test_sdb_memory_limit);
+	mu_run_test (test_sdb_now);
+	mu_run_test (test_sdb_expire_tick);
+	mu_run_test (test_sdb_expire_disk);
+	mu_run_test (test_sdb_disk_cache);
+	mu_run_test (test_sdb_bin);
+	mu_run_test (test_sdb_bin_zero);
+	mu_run_test (test_sdb_key);
+	mu_run_test (test_sdb_set_batch);
+	mu_run_test (test_sdb_builder);
+	mu_run_test (test_sdb_make_parallel);
+	mu_run_test (test_sdb_cluster);
+	mu_run_test (test_sdb_advice);
+	mu_run_test (test_sdb_nomap);
+	mu_run_test (test_sdb_async);
+	mu_run_test (test_sdb_write_buffer);
+	mu_run_test (test_sdb_checksum);
+	mu_run_test (test_sdb_compress);
+	mu_run_test (test_sdb_builder_sorted);
+	mu_run_test (test_sdb_dedup);
+	mu_run_test (test_sdb_num_typed);
 	return tests_passed != tests_run;
 }
 